@@ -1,137 +1,149 @@
 #include <assert.h>
-#include <limits.h>
+#include <string.h>
 
 #include "errlog.h"
-#include "cadef.h"
 
 #define epicsExportSharedSymbols
 #include "pv.h"
 
-#define INVOKE(x, expr) \
-    {\
-        int _status = expr;\
-        if (!(_status & CA_M_SUCCESS)) {\
-            (x)->msg = ca_message(_status);\
-            errlogSevPrintf(sevrFromCA(_status), "%s: %s", #expr, ca_message(_status));\
-            return statFromCA(_status);\
-        }\
-    }
+epicsShareDef const struct pvSystem nullPvSys = {NULL,NULL,NULL};
+epicsShareDef const struct pvVar nullPvVar = {NULL,NULL,NULL,NULL,NULL,NULL,NULL};
 
-epicsShareDef const struct pvSystem nullPvSys = {NULL};
-epicsShareDef const struct pvVar nullPvVar = {NULL,NULL,NULL,NULL,NULL,NULL};
+/* available backends, the first one is the default */
+#define MAX_BACKENDS 8
 
-/* utilities */
-static pvSevr sevrFromCA(long status);  /* CA severity as pvSevr */
-static pvStat statFromCA(long status);  /* CA status as pvStat */
-static pvType typeFromCA(long type);    /* DBR type as pvType */
-static chtype typeToCA(pvType type);    /* pvType as DBR type */
+static const pvBackend *backends[MAX_BACKENDS] = {
+    &pvBackendCA,
+    &pvBackendLoop,
+};
+static unsigned numBackends = 2;
 
-epicsShareFunc pvStat pvSysCreate(pvSystem *pSys)
+epicsShareFunc const pvBackend *pvBackendFind(const char *name)
 {
-    assert(pSys);
-    assert(!ca_current_context());
-    INVOKE(pSys, ca_context_create(ca_enable_preemptive_callback));
-    pSys->id = ca_current_context();
-    return pvStatOK;
-}
+    unsigned n;
 
-epicsShareFunc pvStat pvSysFlush(pvSystem sys)
-{
-    INVOKE(&sys, ca_flush_io());
-    return pvStatOK;
+    if (!name || !name[0])
+        return backends[0];
+    for (n = 0; n < numBackends; n++) {
+        if (strcmp(backends[n]->name, name) == 0)
+            return backends[n];
+    }
+    return NULL;
 }
 
-epicsShareFunc pvStat pvSysAttach(pvSystem sys)
+/* Called by registrars (before iocInit) to add backends that live in
+   other libraries, see pvDb.c */
+epicsShareFunc pvStat pvBackendRegister(const pvBackend *backend)
 {
-    if (!ca_current_context())
-        INVOKE(&sys, ca_attach_context(sys.id));
+    assert(backend && backend->name);
+    if (pvBackendFind(backend->name) == backend)
+        return pvStatOK;
+    if (pvBackendFind(backend->name) || numBackends == MAX_BACKENDS) {
+        errlogSevPrintf(errlogMajor, "pvBackendRegister: cannot register pv system '%s'\n",
+            backend->name);
+        return pvStatERROR;
+    }
+    backends[numBackends++] = backend;
     return pvStatOK;
 }
 
-static void pvCaConnectionHandler(struct connection_handler_args args)
+epicsShareFunc pvStat pvSysCreate(pvSystem *pSys)
 {
-    pvVar *var = (pvVar *)ca_puser(args.chid);
-    var->conn_handler(args.op == CA_OP_CONN_UP, var->arg);
+    return pvSysCreateByName(pSys, NULL);
 }
 
-epicsShareFunc pvStat pvVarCreate(pvSystem sys, const char *name,
-    pvConnFunc *conn_func, pvEventFunc *event_func, void *arg, pvVar *var)
+epicsShareFunc pvStat pvSysCreateByName(pvSystem *pSys, const char *name)
 {
-    assert(var);
-    var->conn_handler = conn_func;
-    var->event_handler = event_func;
-    var->arg = arg;
-    INVOKE(var, ca_create_channel(name, pvCaConnectionHandler, var, CA_PRIORITY_DEFAULT, &var->chid));
-    return pvStatOK;
-}
+    const pvBackend *backend = pvBackendFind(name);
+    pvStat status;
 
-epicsShareFunc pvStat pvVarDestroy(pvVar *var)
-{
-    assert(var);
-    INVOKE(var, ca_clear_channel(var->chid));
-    *var = nullPvVar;
-    return pvStatOK;
+    assert(pSys);
+    *pSys = nullPvSys;
+    if (!backend) {
+        pSys->msg = "unknown pv system";
+        errlogSevPrintf(errlogMajor, "pvSysCreate: unknown pv system '%s'\n", name);
+        return pvStatERROR;
+    }
+    pSys->backend = backend;
+    status = backend->sysCreate(pSys);
+    if (status == pvStatOK)
+        assert(pSys->id);
+    return status;
 }
 
-static void pvCaEventHandler(struct event_handler_args args, pvEventType evt)
+epicsShareFunc pvStat pvSysFlush(pvSystem sys)
 {
-    pvVar *var = (pvVar *)ca_puser(args.chid);
-    unsigned count = (unsigned)args.count;
-    assert(args.count >= 0);
-    assert((long)count == args.count);
-    var->msg = ca_message(args.status);
-    var->event_handler(evt, args.usr, typeFromCA(args.type), count, (pvValue*)args.dbr, statFromCA(args.status));
+    if (!sys.backend)
+        return pvStatERROR;
+    return sys.backend->sysFlush(&sys);
 }
 
-static void pvCaGetHandler(struct event_handler_args args)
+epicsShareFunc pvStat pvSysAttach(pvSystem sys)
 {
-    pvCaEventHandler(args, pvEventGet);
+    if (!sys.backend)
+        return pvStatERROR;
+    return sys.backend->sysAttach(&sys);
 }
 
-static void pvCaPutHandler(struct event_handler_args args)
+epicsShareFunc pvStat pvVarCreate(pvSystem sys, const char *name,
+    pvConnFunc *conn_func, pvEventFunc *event_func, void *arg, pvVar *var)
 {
-    pvCaEventHandler(args, pvEventPut);
+    pvStat status;
+
+    assert(var);
+    *var = nullPvVar;
+    if (!sys.backend) {
+        var->msg = "no pv system";
+        return pvStatERROR;
+    }
+    var->backend = sys.backend;
+    var->conn_handler = conn_func;
+    var->event_handler = event_func;
+    var->arg = arg;
+    status = sys.backend->varCreate(&sys, name, var);
+    if (status == pvStatOK)
+        assert(var->chid);
+    return status;
 }
 
-static void pvCaMonitorHandler(struct event_handler_args args)
+epicsShareFunc pvStat pvVarDestroy(pvVar *var)
 {
-    pvCaEventHandler(args, pvEventMonitor);
+    pvStat status;
+
+    assert(var);
+    status = var->backend->varDestroy(var);
+    if (status == pvStatOK)
+        *var = nullPvVar;
+    return status;
 }
 
 epicsShareFunc pvStat pvVarGetCallback(pvVar *var, pvType type, unsigned count, void *arg)
 {
     assert(var);
     assert(pv_is_valid_type(type));
-    INVOKE(var, ca_array_get_callback(
-        typeToCA(type), count, var->chid, pvCaGetHandler, arg));
-    return pvStatOK;
+    return var->backend->varGetCallback(var, type, count, arg);
 }
 
 epicsShareFunc pvStat pvVarPutNoBlock(pvVar *var, pvType type, unsigned count, pvValue *value)
 {
     assert(var);
     assert(pv_is_simple_type(type));
-    INVOKE(var, ca_array_put(typeToCA(type), count, var->chid, value));
-    return pvStatOK;
+    return var->backend->varPutNoBlock(var, type, count, value);
 }
 
 epicsShareFunc pvStat pvVarPutCallback(pvVar *var, pvType type, unsigned count, pvValue *value, void *arg)
 {
     assert(var);
     assert(pv_is_simple_type(type));
-    INVOKE(var, ca_array_put_callback(
-        typeToCA(type), count, var->chid, value, pvCaPutHandler, arg));
-    return pvStatOK;
+    return var->backend->varPutCallback(var, type, count, value, arg);
 }
 
 epicsShareFunc pvStat pvVarMonitorOn(pvVar *var, pvType type, unsigned count, void *arg)
 {
     assert(var);
     assert(pv_is_valid_type(type));
-    if (var->monid == NULL) {
-        INVOKE(var, ca_create_subscription(typeToCA(type), count, var->chid,
-            DBE_VALUE | DBE_ALARM, pvCaMonitorHandler, arg, &var->monid));
-    }
+    if (var->monid == NULL)
+        return var->backend->varMonitorOn(var, type, count, arg);
     return pvStatOK;
 }
 
@@ -139,7 +151,9 @@ epicsShareFunc pvStat pvVarMonitorOff(pvVar *var)
 {
     assert(var);
     if (var->monid != NULL) {
-        INVOKE(var, ca_clear_event(var->monid));
+        pvStat status = var->backend->varMonitorOff(var);
+        if (status != pvStatOK)
+            return status;
         var->monid = NULL;
     }
     return pvStatOK;
@@ -147,9 +161,8 @@ epicsShareFunc pvStat pvVarMonitorOff(pvVar *var)
 
 epicsShareFunc unsigned pvVarGetCount(pvVar *var)
 {
-    unsigned long c = ca_element_count(var->chid);
-    assert(c <= UINT_MAX);
-    return (unsigned)c;
+    assert(var);
+    return var->backend->varGetCount(var);
 }
 
 epicsShareFunc int pvTimeGetCurrentDouble(double *pTime)
@@ -165,67 +178,6 @@ epicsShareFunc int pvTimeGetCurrentDouble(double *pTime)
     return pvStatOK;
 }
 
-#include "alarm.h"
-
-static pvSevr sevrFromCA(long status)
-{
-    switch (CA_EXTRACT_SEVERITY(status)) {
-        case CA_K_INFO:    return pvSevrNONE;
-        case CA_K_SUCCESS: return pvSevrNONE;
-        case CA_K_WARNING: return pvSevrMINOR;
-        case CA_K_ERROR:   return pvSevrMAJOR;
-        case CA_K_SEVERE:  return pvSevrINVALID;
-        default:           return pvSevrERROR;
-    }
-}
-
-static pvStat statFromCA(long status)
-{
-    pvSevr sevr = sevrFromCA(status);
-    return (sevr == pvSevrNONE || sevr == pvSevrMINOR) ?
-                pvStatOK : pvStatERROR;
-}
-
-static pvType typeFromCA(long type)
-{
-    switch (type) {
-        case DBR_CHAR:          return pvTypeCHAR;
-        case DBR_SHORT:         return pvTypeSHORT;
-        case DBR_ENUM:          return pvTypeSHORT;
-        case DBR_LONG:          return pvTypeLONG;
-        case DBR_FLOAT:         return pvTypeFLOAT;
-        case DBR_DOUBLE:        return pvTypeDOUBLE;
-        case DBR_STRING:        return pvTypeSTRING;
-        case DBR_TIME_CHAR:     return pvTypeTIME_CHAR;
-        case DBR_TIME_SHORT:    return pvTypeTIME_SHORT;
-        case DBR_TIME_ENUM:     return pvTypeTIME_SHORT;
-        case DBR_TIME_LONG:     return pvTypeTIME_LONG;
-        case DBR_TIME_FLOAT:    return pvTypeTIME_FLOAT;
-        case DBR_TIME_DOUBLE:   return pvTypeTIME_DOUBLE;
-        case DBR_TIME_STRING:   return pvTypeTIME_STRING;
-        default:                return pvTypeERROR;
-    }
-}
-
-static chtype typeToCA(pvType type)
-{
-    switch (type) {
-        case pvTypeCHAR:        return DBR_CHAR;
-        case pvTypeSHORT:       return DBR_SHORT;
-        case pvTypeLONG:        return DBR_LONG;
-        case pvTypeFLOAT:       return DBR_FLOAT;
-        case pvTypeDOUBLE:      return DBR_DOUBLE;
-        case pvTypeSTRING:      return DBR_STRING;
-        case pvTypeTIME_CHAR:   return DBR_TIME_CHAR;
-        case pvTypeTIME_SHORT:  return DBR_TIME_SHORT;
-        case pvTypeTIME_LONG:   return DBR_TIME_LONG;
-        case pvTypeTIME_FLOAT:  return DBR_TIME_FLOAT;
-        case pvTypeTIME_DOUBLE: return DBR_TIME_DOUBLE;
-        case pvTypeTIME_STRING: return DBR_TIME_STRING;
-        default:                return -1;
-    }
-}
-
 #include "db_access.h"
 
 typedef struct dbr_time_char    pvTimeChar;
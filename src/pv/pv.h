@@ -35,25 +35,57 @@ typedef enum {
 
 typedef struct pvSystem pvSystem;
 typedef struct pvVar pvVar;
+typedef struct pvBackend pvBackend;
 typedef void pvConnFunc(int connected, void *arg);
 typedef void pvEventFunc(pvEventType evt, void *arg, pvType type, unsigned count, pvValue *value, pvStat status);
 
 /* structures must be allocated by client code */
 
 struct pvSystem {
-    struct ca_client_context *id;
+    const pvBackend *backend;
+    void *id;
     const char *msg;
 };
 
 struct pvVar {
-    struct oldChannelNotify *chid;
-    struct oldSubscription *monid;
+    const pvBackend *backend;
+    void *chid;
+    void *monid;
     pvConnFunc *conn_handler;
     pvEventFunc *event_handler;
     void *arg;
     const char *msg;
 };
 
+/*
+ * A message system backend. The generic functions below check their
+ * arguments, fill in the common members of pvVar, and then dispatch to
+ * the backend of the pvSystem resp. pvVar. The backend sets the id
+ * member of a new pvSystem and the chid member of a new pvVar (both
+ * must then be non-NULL), and calls the var's conn_handler and
+ * event_handler with the var's arg resp. the arg passed to
+ * varGetCallback, varPutCallback, or varMonitorOn. Destroying a var or
+ * monitor must wait for callbacks in progress to complete, unless
+ * called from within such a callback.
+ */
+struct pvBackend {
+    const char *name;
+    pvStat (*sysCreate)(pvSystem *sys);
+    pvStat (*sysFlush)(pvSystem *sys);
+    pvStat (*sysAttach)(pvSystem *sys);
+    pvStat (*varCreate)(pvSystem *sys, const char *name, pvVar *var);
+    pvStat (*varDestroy)(pvVar *var);
+    pvStat (*varGetCallback)(pvVar *var, pvType type, unsigned count, void *arg);
+    pvStat (*varPutNoBlock)(pvVar *var, pvType type, unsigned count, pvValue *value);
+    pvStat (*varPutCallback)(pvVar *var, pvType type, unsigned count, pvValue *value, void *arg);
+    pvStat (*varMonitorOn)(pvVar *var, pvType type, unsigned count, void *arg);
+    pvStat (*varMonitorOff)(pvVar *var);
+    unsigned (*varGetCount)(pvVar *var);
+};
+
+epicsShareExtern const pvBackend pvBackendCA;   /* Channel Access, see pvCa.c */
+epicsShareExtern const pvBackend pvBackendLoop; /* in-process loopback, see pvLoop.c */
+
 #define pvSysIsDefined(x) ((x).id != NULL)
 #define pvVarIsDefined(x) ((x).chid != NULL)
 #define pvMonIsDefined(x) ((x).monid != NULL)
@@ -61,7 +93,11 @@ struct pvVar {
 epicsShareExtern const struct pvSystem nullPvSys;
 epicsShareExtern const struct pvVar nullPvVar;
 
+epicsShareFunc const pvBackend *pvBackendFind(const char *name);
+epicsShareFunc pvStat pvBackendRegister(const pvBackend *backend);
+
 epicsShareFunc pvStat pvSysCreate(pvSystem *pSys);
+epicsShareFunc pvStat pvSysCreateByName(pvSystem *pSys, const char *name);
 epicsShareFunc pvStat pvSysFlush(pvSystem sys);
 epicsShareFunc pvStat pvSysAttach(pvSystem sys);
 
@@ -80,6 +116,7 @@ epicsShareFunc unsigned pvVarGetCount(pvVar *var);
 #define pvVarGetPrivate(var) (var).arg
 #define pvVarGetMess(var) (var).msg
 #define pvSysGetMess(sys) (sys).msg
+#define pvSysGetName(sys) (sys).backend->name
 
 epicsShareFunc pvStat pvTimeGetCurrentDouble(double *pTime);
 
@@ -0,0 +1,215 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/* Channel Access backend for the pv layer. */
+#include <assert.h>
+#include <limits.h>
+
+#include "errlog.h"
+#include "cadef.h"
+
+#define epicsExportSharedSymbols
+#include "pv.h"
+
+#define INVOKE(x, expr) \
+    {\
+        int _status = expr;\
+        if (!(_status & CA_M_SUCCESS)) {\
+            (x)->msg = ca_message(_status);\
+            errlogSevPrintf(sevrFromCA(_status), "%s: %s", #expr, ca_message(_status));\
+            return statFromCA(_status);\
+        }\
+    }
+
+/* utilities */
+static pvSevr sevrFromCA(long status);  /* CA severity as pvSevr */
+static pvStat statFromCA(long status);  /* CA status as pvStat */
+static pvType typeFromCA(long type);    /* DBR type as pvType */
+static chtype typeToCA(pvType type);    /* pvType as DBR type */
+
+static pvStat caSysCreate(pvSystem *pSys)
+{
+    assert(!ca_current_context());
+    INVOKE(pSys, ca_context_create(ca_enable_preemptive_callback));
+    pSys->id = ca_current_context();
+    return pvStatOK;
+}
+
+static pvStat caSysFlush(pvSystem *pSys)
+{
+    INVOKE(pSys, ca_flush_io());
+    return pvStatOK;
+}
+
+static pvStat caSysAttach(pvSystem *pSys)
+{
+    if (!ca_current_context())
+        INVOKE(pSys, ca_attach_context((struct ca_client_context *)pSys->id));
+    return pvStatOK;
+}
+
+static void pvCaConnectionHandler(struct connection_handler_args args)
+{
+    pvVar *var = (pvVar *)ca_puser(args.chid);
+    var->conn_handler(args.op == CA_OP_CONN_UP, var->arg);
+}
+
+static pvStat caVarCreate(pvSystem *pSys, const char *name, pvVar *var)
+{
+    chid id;
+
+    INVOKE(var, ca_create_channel(name, pvCaConnectionHandler, var, CA_PRIORITY_DEFAULT, &id));
+    var->chid = id;
+    return pvStatOK;
+}
+
+static pvStat caVarDestroy(pvVar *var)
+{
+    INVOKE(var, ca_clear_channel((chid)var->chid));
+    return pvStatOK;
+}
+
+static void pvCaEventHandler(struct event_handler_args args, pvEventType evt)
+{
+    pvVar *var = (pvVar *)ca_puser(args.chid);
+    unsigned count = (unsigned)args.count;
+    assert(args.count >= 0);
+    assert((long)count == args.count);
+    var->msg = ca_message(args.status);
+    var->event_handler(evt, args.usr, typeFromCA(args.type), count, (pvValue*)args.dbr, statFromCA(args.status));
+}
+
+static void pvCaGetHandler(struct event_handler_args args)
+{
+    pvCaEventHandler(args, pvEventGet);
+}
+
+static void pvCaPutHandler(struct event_handler_args args)
+{
+    pvCaEventHandler(args, pvEventPut);
+}
+
+static void pvCaMonitorHandler(struct event_handler_args args)
+{
+    pvCaEventHandler(args, pvEventMonitor);
+}
+
+static pvStat caVarGetCallback(pvVar *var, pvType type, unsigned count, void *arg)
+{
+    INVOKE(var, ca_array_get_callback(
+        typeToCA(type), count, (chid)var->chid, pvCaGetHandler, arg));
+    return pvStatOK;
+}
+
+static pvStat caVarPutNoBlock(pvVar *var, pvType type, unsigned count, pvValue *value)
+{
+    INVOKE(var, ca_array_put(typeToCA(type), count, (chid)var->chid, value));
+    return pvStatOK;
+}
+
+static pvStat caVarPutCallback(pvVar *var, pvType type, unsigned count, pvValue *value, void *arg)
+{
+    INVOKE(var, ca_array_put_callback(
+        typeToCA(type), count, (chid)var->chid, value, pvCaPutHandler, arg));
+    return pvStatOK;
+}
+
+static pvStat caVarMonitorOn(pvVar *var, pvType type, unsigned count, void *arg)
+{
+    evid id;
+
+    INVOKE(var, ca_create_subscription(typeToCA(type), count, (chid)var->chid,
+        DBE_VALUE | DBE_ALARM, pvCaMonitorHandler, arg, &id));
+    var->monid = id;
+    return pvStatOK;
+}
+
+static pvStat caVarMonitorOff(pvVar *var)
+{
+    INVOKE(var, ca_clear_event((evid)var->monid));
+    return pvStatOK;
+}
+
+static unsigned caVarGetCount(pvVar *var)
+{
+    unsigned long c = ca_element_count((chid)var->chid);
+    assert(c <= UINT_MAX);
+    return (unsigned)c;
+}
+
+epicsShareDef const pvBackend pvBackendCA = {
+    "ca",
+    caSysCreate,
+    caSysFlush,
+    caSysAttach,
+    caVarCreate,
+    caVarDestroy,
+    caVarGetCallback,
+    caVarPutNoBlock,
+    caVarPutCallback,
+    caVarMonitorOn,
+    caVarMonitorOff,
+    caVarGetCount
+};
+
+#include "alarm.h"
+
+static pvSevr sevrFromCA(long status)
+{
+    switch (CA_EXTRACT_SEVERITY(status)) {
+        case CA_K_INFO:    return pvSevrNONE;
+        case CA_K_SUCCESS: return pvSevrNONE;
+        case CA_K_WARNING: return pvSevrMINOR;
+        case CA_K_ERROR:   return pvSevrMAJOR;
+        case CA_K_SEVERE:  return pvSevrINVALID;
+        default:           return pvSevrERROR;
+    }
+}
+
+static pvStat statFromCA(long status)
+{
+    pvSevr sevr = sevrFromCA(status);
+    return (sevr == pvSevrNONE || sevr == pvSevrMINOR) ?
+                pvStatOK : pvStatERROR;
+}
+
+static pvType typeFromCA(long type)
+{
+    switch (type) {
+        case DBR_CHAR:          return pvTypeCHAR;
+        case DBR_SHORT:         return pvTypeSHORT;
+        case DBR_ENUM:          return pvTypeSHORT;
+        case DBR_LONG:          return pvTypeLONG;
+        case DBR_FLOAT:         return pvTypeFLOAT;
+        case DBR_DOUBLE:        return pvTypeDOUBLE;
+        case DBR_STRING:        return pvTypeSTRING;
+        case DBR_TIME_CHAR:     return pvTypeTIME_CHAR;
+        case DBR_TIME_SHORT:    return pvTypeTIME_SHORT;
+        case DBR_TIME_ENUM:     return pvTypeTIME_SHORT;
+        case DBR_TIME_LONG:     return pvTypeTIME_LONG;
+        case DBR_TIME_FLOAT:    return pvTypeTIME_FLOAT;
+        case DBR_TIME_DOUBLE:   return pvTypeTIME_DOUBLE;
+        case DBR_TIME_STRING:   return pvTypeTIME_STRING;
+        default:                return pvTypeERROR;
+    }
+}
+
+static chtype typeToCA(pvType type)
+{
+    switch (type) {
+        case pvTypeCHAR:        return DBR_CHAR;
+        case pvTypeSHORT:       return DBR_SHORT;
+        case pvTypeLONG:        return DBR_LONG;
+        case pvTypeFLOAT:       return DBR_FLOAT;
+        case pvTypeDOUBLE:      return DBR_DOUBLE;
+        case pvTypeSTRING:      return DBR_STRING;
+        case pvTypeTIME_CHAR:   return DBR_TIME_CHAR;
+        case pvTypeTIME_SHORT:  return DBR_TIME_SHORT;
+        case pvTypeTIME_LONG:   return DBR_TIME_LONG;
+        case pvTypeTIME_FLOAT:  return DBR_TIME_FLOAT;
+        case pvTypeTIME_DOUBLE: return DBR_TIME_DOUBLE;
+        case pvTypeTIME_STRING: return DBR_TIME_STRING;
+        default:                return -1;
+    }
+}
@@ -0,0 +1,630 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/* Database access backend for the pv layer.
+ *
+ * For programs running inside an IOC: names of local records are
+ * accessed directly through dbChannel, with db event subscriptions for
+ * monitors and process notification for puts with completion. This
+ * avoids the CA client library with its threads and extra copies. All
+ * other names are handed over to the CA backend, which then takes over
+ * the pvVar completely.
+ *
+ * As with CA, callbacks are called from a separate thread, namely the
+ * db event task of the pv system.
+ *
+ * Register with pvDb.dbd and select with the program parameter
+ * "pvsys=db".
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "errlog.h"
+#include "epicsMutex.h"
+#include "epicsThread.h"
+#include "cadef.h"
+#include "dbAccess.h"
+#include "dbChannel.h"
+#include "dbEvent.h"
+#include "dbNotify.h"
+#include "epicsExport.h"
+
+#include "pv.h"
+
+typedef struct db_sys   DBSYS;
+typedef struct db_var   DBVAR;
+typedef struct db_mon   DBMON;
+typedef struct db_put   DBPUT;
+typedef struct db_req   DBREQ;
+
+struct db_sys {
+    pvSystem        ca;         /* for names that are not local */
+    dbEventCtx      ctx;
+    epicsThreadId   task;       /* event task, calls all callbacks */
+    epicsMutexId    lock;       /* protects the members below */
+    DBREQ           *first;     /* callbacks to be called */
+    DBREQ           *last;
+    DBVAR           *busy;      /* var whose callback is running */
+};
+
+struct db_var {
+    DBSYS           *sys;
+    dbChannel       *chan;
+    pvVar           *var;
+    DBMON           *mons;
+    DBPUT           *puts;      /* puts waiting for completion */
+};
+
+struct db_mon {
+    DBMON           *next;
+    DBVAR           *dv;
+    dbEventSubscription sub;
+    pvType          type;
+    unsigned        count;
+    void            *arg;
+    void            *buf;       /* for dbChannelGet */
+};
+
+struct db_put {
+    processNotify   pn;
+    DBPUT           *next;
+    DBVAR           *dv;
+    pvType          type;
+    unsigned        count;
+    void            *arg;
+    pvStat          status;
+    pvValue         *value;
+};
+
+enum db_req_kind { dbConnect, dbGet, dbPutDone };
+
+struct db_req {
+    DBREQ           *next;
+    enum db_req_kind kind;
+    DBVAR           *dv;
+    void            *arg;
+    pvType          type;
+    unsigned        count;
+    DBPUT           *put;       /* only for dbPutDone */
+};
+
+/* Header of a dbChannelGet buffer with options DBR_STATUS|DBR_TIME */
+struct db_time_header {
+    DBRstatus
+    DBRtime
+};
+
+/* pvType as database request type */
+static short typeToDb(pvType type)
+{
+    switch (pv_is_time_type(type) ? type - pvTypeTIME_CHAR : type) {
+    case pvTypeCHAR:    return DBR_UCHAR;
+    case pvTypeSHORT:   return DBR_SHORT;
+    case pvTypeLONG:    return DBR_LONG;
+    case pvTypeFLOAT:   return DBR_FLOAT;
+    case pvTypeDOUBLE:  return DBR_DOUBLE;
+    case pvTypeSTRING:  return DBR_STRING;
+    default:            return -1;
+    }
+}
+
+/* Number of elements delivered for a requested count */
+static unsigned dbCount(DBVAR *dv, unsigned count)
+{
+    unsigned n = (unsigned)dbChannelFinalElements(dv->chan);
+
+    return (count == 0 || count > n) ? n : count;
+}
+
+/*
+ * Read the channel's value (from the field log if not NULL) into a
+ * pv layer buffer of the given type. On return, *pCount contains the
+ * number of elements actually read. The buffer tmp must be large
+ * enough for the db time header plus the values.
+ */
+static pvStat dbRead(DBVAR *dv, pvType type, unsigned *pCount,
+    void *buf, void *tmp, void *pfl)
+{
+    long options = 0, nRequest = *pCount;
+    long status;
+
+    if (!pv_is_time_type(type)) {
+        dbScanLock(dbChannelRecord(dv->chan));
+        status = dbChannelGet(dv->chan, typeToDb(type), buf, &options,
+            &nRequest, pfl);
+        dbScanUnlock(dbChannelRecord(dv->chan));
+    } else {
+        struct db_time_header *hdr = (struct db_time_header *)tmp;
+        unsigned i = type - pvTypeTIME_CHAR;
+
+        options = DBR_STATUS | DBR_TIME;
+        dbScanLock(dbChannelRecord(dv->chan));
+        status = dbChannelGet(dv->chan, typeToDb(type), tmp, &options,
+            &nRequest, pfl);
+        dbScanUnlock(dbChannelRecord(dv->chan));
+        if (!status) {
+            *(epicsInt16 *)((char *)buf + pv_status_offsets[i]) = hdr->status;
+            *(epicsInt16 *)((char *)buf + pv_severity_offsets[i]) = hdr->severity;
+            memcpy((char *)buf + pv_stamp_offsets[i], &hdr->time,
+                sizeof(epicsTimeStamp));
+            memcpy(pv_value_ptr(buf, type), hdr + 1,
+                nRequest * pv_value_sizes[type]);
+        }
+    }
+    if (status) {
+        dv->var->msg = "dbChannelGet failed";
+        return pvStatERROR;
+    }
+    *pCount = (unsigned)nRequest;
+    return pvStatOK;
+}
+
+/* Size of the temporary buffer for dbRead */
+static size_t dbReadSize(pvType type, unsigned count)
+{
+    return sizeof(struct db_time_header) + count * pv_value_sizes[type];
+}
+
+/* Offset of the temporary buffer behind a pv layer buffer */
+static size_t dbReadOffset(pvType type, unsigned count)
+{
+    size_t align = sizeof(double);
+
+    return (pv_size_n(type, count) + align - 1) / align * align;
+}
+
+static void dbQueue(DBSYS *sys, DBREQ *req)
+{
+    epicsMutexMustLock(sys->lock);
+    req->next = NULL;
+    if (sys->last)
+        sys->last->next = req;
+    else
+        sys->first = req;
+    sys->last = req;
+    epicsMutexUnlock(sys->lock);
+    db_post_extra_labor(sys->ctx);
+}
+
+static pvStat dbRequest(DBVAR *dv, enum db_req_kind kind, void *arg,
+    pvType type, unsigned count, DBPUT *put)
+{
+    DBREQ *req = calloc(1, sizeof(DBREQ));
+
+    if (!req) {
+        dv->var->msg = "out of memory";
+        return pvStatERROR;
+    }
+    req->kind = kind;
+    req->dv = dv;
+    req->arg = arg;
+    req->type = type;
+    req->count = count;
+    req->put = put;
+    dbQueue(dv->sys, req);
+    return pvStatOK;
+}
+
+/* Remove queued requests for dv; must hold sys->lock */
+static void dbCancel(DBSYS *sys, DBVAR *dv)
+{
+    DBREQ **pp = &sys->first, *req;
+
+    sys->last = NULL;
+    while ((req = *pp)) {
+        if (req->dv == dv) {
+            *pp = req->next;
+            free(req);
+        } else {
+            sys->last = req;
+            pp = &req->next;
+        }
+    }
+}
+
+static void dbCallGet(DBREQ *req)
+{
+    DBVAR *dv = req->dv;
+    pvVar *var = dv->var;
+    unsigned count = req->count;
+    void *buf = calloc(1, pv_size_n(req->type, count));
+    void *tmp = malloc(dbReadSize(req->type, count));
+    pvStat status = pvStatERROR;
+
+    if (buf && tmp)
+        status = dbRead(dv, req->type, &count, buf, tmp, NULL);
+    else
+        var->msg = "out of memory";
+    var->event_handler(pvEventGet, req->arg, req->type, count,
+        status == pvStatOK ? buf : NULL, status);
+    free(tmp);
+    free(buf);
+}
+
+static void dbCallPutDone(DBREQ *req)
+{
+    DBPUT *put = req->put, **pp;
+    DBVAR *dv = req->dv;
+
+    epicsMutexMustLock(dv->sys->lock);
+    for (pp = &dv->puts; *pp && *pp != put; pp = &(*pp)->next)
+        ;
+    if (!*pp) {
+        /* canceled, dbVarDestroy frees it */
+        epicsMutexUnlock(dv->sys->lock);
+        return;
+    }
+    *pp = put->next;
+    epicsMutexUnlock(dv->sys->lock);
+    if (put->status != pvStatOK)
+        dv->var->msg = "put failed";
+    dv->var->event_handler(pvEventPut, put->arg, put->type, put->count,
+        NULL, put->status);
+    free(put->value);
+    free(put);
+}
+
+/* Runs in the event task */
+static void dbLabor(void *arg)
+{
+    DBSYS *sys = (DBSYS *)arg;
+    DBREQ *req;
+
+    epicsMutexMustLock(sys->lock);
+    while ((req = sys->first)) {
+        sys->first = req->next;
+        if (!sys->first)
+            sys->last = NULL;
+        sys->busy = req->dv;
+        epicsMutexUnlock(sys->lock);
+
+        switch (req->kind) {
+        case dbConnect:
+            req->dv->var->conn_handler(TRUE, req->dv->var->arg);
+            break;
+        case dbGet:
+            dbCallGet(req);
+            break;
+        case dbPutDone:
+            dbCallPutDone(req);
+            break;
+        }
+        free(req);
+
+        epicsMutexMustLock(sys->lock);
+        sys->busy = NULL;
+    }
+    epicsMutexUnlock(sys->lock);
+}
+
+static void dbTaskInit(void *arg)
+{
+    DBSYS *sys = (DBSYS *)arg;
+
+    sys->task = epicsThreadGetIdSelf();
+    pvBackendCA.sysAttach(&sys->ca);
+}
+
+/* Wait until no callback for dv is running, unless we are called from
+   inside it; must hold sys->lock */
+static void dbWaitIdle(DBSYS *sys, DBVAR *dv)
+{
+    if (epicsThreadGetIdSelf() == sys->task)
+        return;
+    while (sys->busy == dv) {
+        epicsMutexUnlock(sys->lock);
+        epicsThreadSleep(0.01);
+        epicsMutexMustLock(sys->lock);
+    }
+}
+
+static pvStat dbSysCreate(pvSystem *pSys)
+{
+    DBSYS *sys = calloc(1, sizeof(DBSYS));
+    pvStat status;
+
+    if (!sys || !(sys->lock = epicsMutexCreate())) {
+        free(sys);
+        pSys->msg = "out of memory";
+        errlogSevPrintf(errlogFatal, "pvSysCreate(db): out of memory\n");
+        return pvStatERROR;
+    }
+    sys->ca.backend = &pvBackendCA;
+    status = pvBackendCA.sysCreate(&sys->ca);
+    if (status != pvStatOK) {
+        pSys->msg = sys->ca.msg;
+        epicsMutexDestroy(sys->lock);
+        free(sys);
+        return status;
+    }
+    sys->ctx = db_init_events();
+    if (!sys->ctx
+        || db_add_extra_labor_event(sys->ctx, dbLabor, sys)
+        || db_start_events(sys->ctx, "pvDb", dbTaskInit, sys,
+            epicsThreadPriorityMedium)) {
+        pSys->msg = "cannot start db event task";
+        errlogSevPrintf(errlogFatal, "pvSysCreate(db): cannot start db event task\n");
+        if (sys->ctx)
+            db_close_events(sys->ctx);
+        /* the CA backend has no sysDestroy, but its context is still
+           the current one of this thread */
+        ca_context_destroy();
+        epicsMutexDestroy(sys->lock);
+        free(sys);
+        return pvStatERROR;
+    }
+    pSys->id = sys;
+    return pvStatOK;
+}
+
+static pvStat dbSysFlush(pvSystem *pSys)
+{
+    DBSYS *sys = (DBSYS *)pSys->id;
+
+    return pvBackendCA.sysFlush(&sys->ca);
+}
+
+static pvStat dbSysAttach(pvSystem *pSys)
+{
+    DBSYS *sys = (DBSYS *)pSys->id;
+
+    return pvBackendCA.sysAttach(&sys->ca);
+}
+
+static pvStat dbVarCreate(pvSystem *pSys, const char *name, pvVar *var)
+{
+    DBSYS *sys = (DBSYS *)pSys->id;
+    dbChannel *chan = pdbbase ? dbChannelCreate(name) : NULL;
+    DBVAR *dv;
+
+    if (!chan) {
+        /* not a local record: CA takes over */
+        var->backend = &pvBackendCA;
+        return pvBackendCA.varCreate(&sys->ca, name, var);
+    }
+    if (dbChannelOpen(chan)) {
+        var->msg = "dbChannelOpen failed";
+        errlogSevPrintf(errlogMajor, "pvVarCreate(db): dbChannelOpen(%s) failed\n", name);
+        dbChannelDelete(chan);
+        return pvStatERROR;
+    }
+    dv = calloc(1, sizeof(DBVAR));
+    if (!dv) {
+        var->msg = "out of memory";
+        dbChannelDelete(chan);
+        return pvStatERROR;
+    }
+    dv->sys = sys;
+    dv->chan = chan;
+    dv->var = var;
+    var->chid = dv;
+    /* local records are always connected */
+    return dbRequest(dv, dbConnect, NULL, pvTypeERROR, 0, NULL);
+}
+
+static pvStat dbMonitorCancel(DBMON *mon);
+
+static pvStat dbVarDestroy(pvVar *var)
+{
+    DBVAR *dv = (DBVAR *)var->chid;
+    DBSYS *sys = dv->sys;
+    DBPUT *canceled = NULL;
+
+    while (dv->mons) {
+        DBMON *mon = dv->mons;
+
+        dv->mons = mon->next;
+        dbMonitorCancel(mon);
+    }
+    epicsMutexMustLock(sys->lock);
+    while (dv->puts) {
+        DBPUT *put = dv->puts;
+
+        dv->puts = put->next;
+        put->next = canceled;
+        canceled = put;
+        epicsMutexUnlock(sys->lock);
+        /* waits for the done callback, if already running */
+        dbNotifyCancel(&put->pn);
+        epicsMutexMustLock(sys->lock);
+    }
+    /* now no more requests for dv can be queued */
+    dbWaitIdle(sys, dv);
+    dbCancel(sys, dv);
+    epicsMutexUnlock(sys->lock);
+    while (canceled) {
+        DBPUT *put = canceled;
+
+        canceled = put->next;
+        free(put->value);
+        free(put);
+    }
+    dbChannelDelete(dv->chan);
+    free(dv);
+    return pvStatOK;
+}
+
+static pvStat dbVarGetCallback(pvVar *var, pvType type, unsigned count, void *arg)
+{
+    DBVAR *dv = (DBVAR *)var->chid;
+
+    return dbRequest(dv, dbGet, arg, type, dbCount(dv, count), NULL);
+}
+
+static pvStat dbVarPutNoBlock(pvVar *var, pvType type, unsigned count, pvValue *value)
+{
+    DBVAR *dv = (DBVAR *)var->chid;
+
+    if (dbChannelPutField(dv->chan, typeToDb(type), value, dbCount(dv, count))) {
+        var->msg = "dbChannelPutField failed";
+        return pvStatERROR;
+    }
+    return pvStatOK;
+}
+
+static int dbPutNotifyPut(processNotify *pn, notifyPutType type)
+{
+    DBPUT *put = (DBPUT *)pn->usrPvt;
+    long status = 0;
+
+    switch (type) {
+    case putDisabledType:
+        pn->status = notifyError;
+        return 0;
+    case putFieldType:
+        status = dbChannelPutField(pn->chan, typeToDb(put->type), put->value, put->count);
+        break;
+    case putType:
+        status = dbChannelPut(pn->chan, typeToDb(put->type), put->value, put->count);
+        break;
+    }
+    if (status)
+        pn->status = notifyError;
+    return 1;
+}
+
+/* May be called from within dbProcessNotify, so defer to the event task */
+static void dbPutNotifyDone(processNotify *pn)
+{
+    DBPUT *put = (DBPUT *)pn->usrPvt;
+
+    put->status = pn->status == notifyOK ? pvStatOK : pvStatERROR;
+    dbRequest(put->dv, dbPutDone, put->arg, put->type, put->count, put);
+}
+
+static pvStat dbVarPutCallback(pvVar *var, pvType type, unsigned count, pvValue *value, void *arg)
+{
+    DBVAR *dv = (DBVAR *)var->chid;
+    DBPUT *put = calloc(1, sizeof(DBPUT));
+
+    count = dbCount(dv, count);
+    if (put)
+        put->value = malloc(pv_size_n(type, count));
+    if (!put || !put->value) {
+        free(put);
+        var->msg = "out of memory";
+        return pvStatERROR;
+    }
+    memcpy(put->value, value, pv_size_n(type, count));
+    put->dv = dv;
+    put->type = type;
+    put->count = count;
+    put->arg = arg;
+    put->pn.chan = dv->chan;
+    put->pn.requestType = putProcessRequest;
+    put->pn.putCallback = dbPutNotifyPut;
+    put->pn.doneCallback = dbPutNotifyDone;
+    put->pn.usrPvt = put;
+    epicsMutexMustLock(dv->sys->lock);
+    put->next = dv->puts;
+    dv->puts = put;
+    epicsMutexUnlock(dv->sys->lock);
+    dbProcessNotify(&put->pn);
+    return pvStatOK;
+}
+
+/* Runs in the event task */
+static void dbMonitorEvent(void *arg, struct dbChannel *chan,
+    int eventsRemaining, struct db_field_log *pfl)
+{
+    DBMON *mon = (DBMON *)arg;
+    unsigned count = mon->count;
+    void *buf = mon->buf;
+    pvStat status;
+
+    memset(buf, 0, pv_size_n(mon->type, count));
+    status = dbRead(mon->dv, mon->type, &count, buf,
+        (char *)buf + dbReadOffset(mon->type, mon->count), pfl);
+    mon->dv->var->event_handler(pvEventMonitor, mon->arg, mon->type,
+        count, status == pvStatOK ? buf : NULL, status);
+}
+
+static pvStat dbVarMonitorOn(pvVar *var, pvType type, unsigned count, void *arg)
+{
+    DBVAR *dv = (DBVAR *)var->chid;
+    DBMON *mon = calloc(1, sizeof(DBMON));
+
+    count = dbCount(dv, count);
+    if (mon)
+        /* room for the pv layer value and for dbRead */
+        mon->buf = malloc(dbReadOffset(type, count) + dbReadSize(type, count));
+    if (!mon || !mon->buf) {
+        free(mon);
+        var->msg = "out of memory";
+        return pvStatERROR;
+    }
+    mon->dv = dv;
+    mon->type = type;
+    mon->count = count;
+    mon->arg = arg;
+    mon->sub = db_add_event(dv->sys->ctx, dv->chan, dbMonitorEvent, mon,
+        DBE_VALUE | DBE_ALARM);
+    if (!mon->sub) {
+        free(mon->buf);
+        free(mon);
+        var->msg = "db_add_event failed";
+        return pvStatERROR;
+    }
+    epicsMutexMustLock(dv->sys->lock);
+    mon->next = dv->mons;
+    dv->mons = mon;
+    epicsMutexUnlock(dv->sys->lock);
+    db_event_enable(mon->sub);
+    /* like CA, send the current value first */
+    db_post_single_event(mon->sub);
+    var->monid = mon;
+    return pvStatOK;
+}
+
+/* db_cancel_event waits for a callback in progress */
+static pvStat dbMonitorCancel(DBMON *mon)
+{
+    db_cancel_event(mon->sub);
+    free(mon->buf);
+    free(mon);
+    return pvStatOK;
+}
+
+static pvStat dbVarMonitorOff(pvVar *var)
+{
+    DBMON *mon = (DBMON *)var->monid, **pp;
+    DBVAR *dv = mon->dv;
+
+    epicsMutexMustLock(dv->sys->lock);
+    for (pp = &dv->mons; *pp != mon; pp = &(*pp)->next)
+        ;
+    *pp = mon->next;
+    epicsMutexUnlock(dv->sys->lock);
+    return dbMonitorCancel(mon);
+}
+
+static unsigned dbVarGetCount(pvVar *var)
+{
+    DBVAR *dv = (DBVAR *)var->chid;
+
+    return (unsigned)dbChannelFinalElements(dv->chan);
+}
+
+static const pvBackend pvBackendDb = {
+    "db",
+    dbSysCreate,
+    dbSysFlush,
+    dbSysAttach,
+    dbVarCreate,
+    dbVarDestroy,
+    dbVarGetCallback,
+    dbVarPutNoBlock,
+    dbVarPutCallback,
+    dbVarMonitorOn,
+    dbVarMonitorOff,
+    dbVarGetCount
+};
+
+static void pvDbRegistrar(void)
+{
+    pvBackendRegister(&pvBackendDb);
+}
+
+epicsExportRegistrar(pvDbRegistrar);
@@ -0,0 +1,614 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/* In-process loopback backend for the pv layer.
+ *
+ * Each PV is an array of doubles that lives in the process; it is
+ * created when the first channel refers to its name and destroyed
+ * together with the last one. Channels connect immediately. A put
+ * stores the value and posts a monitor event to all subscribers. The
+ * name may be followed by parameters, as in
+ *
+ *     name?rate=<events per second>&count=<number of elements>
+ *
+ * With a non-zero rate, all elements are periodically incremented and
+ * posted, which makes it possible to measure the sequencer's own
+ * overhead, or run deterministic load tests, without a CA server.
+ *
+ * As with CA, callbacks are called from a separate thread, here one per
+ * pv system. A monitor event that has not yet been delivered is replaced
+ * by a newer one, so a slow consumer only sees the latest value.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "errlog.h"
+#include "epicsEvent.h"
+#include "epicsMutex.h"
+#include "epicsString.h"
+#include "epicsThread.h"
+#include "epicsTime.h"
+
+#define epicsExportSharedSymbols
+#include "pv.h"
+
+typedef struct loop_sys     LOOPSYS;
+typedef struct loop_pv      LOOPPV;
+typedef struct loop_chan    LOOPCHAN;
+typedef struct loop_mon     LOOPMON;
+typedef struct loop_req     LOOPREQ;
+
+struct loop_sys {
+    epicsMutexId    lock;
+    epicsEventId    wakeup;     /* new request or changed rate */
+    epicsEventId    idle;       /* a callback has returned */
+    epicsThreadId   thread;     /* calls all callbacks */
+    LOOPPV          *pvs;
+    LOOPREQ         *first;     /* callbacks to be called */
+    LOOPREQ         *last;
+    LOOPCHAN        *busyChan;  /* channel whose callback is running */
+    LOOPMON         *busyMon;   /* monitor whose callback is running */
+};
+
+struct loop_pv {
+    LOOPPV          *next;
+    char            *name;
+    unsigned        count;
+    double          rate;       /* generated events per second */
+    double          due;        /* time of next generated event */
+    epicsTimeStamp  stamp;
+    double          *value;
+    LOOPCHAN        *chans;
+};
+
+struct loop_chan {
+    LOOPCHAN        *next;
+    LOOPSYS         *sys;
+    LOOPPV          *pv;
+    pvVar           *var;
+    LOOPMON         *mons;
+};
+
+struct loop_mon {
+    LOOPMON         *next;
+    LOOPCHAN        *chan;
+    pvType          type;
+    unsigned        count;
+    void            *arg;
+    LOOPREQ         *pending;   /* queued event (or NULL) */
+};
+
+enum loop_req_kind { loopConnect, loopGet, loopPut, loopMonitor };
+
+struct loop_req {
+    LOOPREQ         *next;
+    enum loop_req_kind kind;
+    LOOPCHAN        *chan;
+    LOOPMON         *mon;       /* only for loopMonitor */
+    void            *arg;
+    pvType          type;
+    unsigned        count;
+    pvValue         *value;
+};
+
+static double now(void)
+{
+    double t;
+
+    pvTimeGetCurrentDouble(&t);
+    return t;
+}
+
+/* Number of elements delivered for a requested count */
+static unsigned loopCount(LOOPPV *pv, unsigned count)
+{
+    return (count == 0 || count > pv->count) ? pv->count : count;
+}
+
+/* Convert the value of pv to the given type and count */
+static pvValue *loopGetValue(LOOPPV *pv, pvType type, unsigned count)
+{
+    pvType base = pv_is_time_type(type) ? type - pvTypeTIME_CHAR : type;
+    pvValue *buf = calloc(1, pv_size_n(type, count));
+    char *vp;
+    unsigned n;
+
+    if (!buf)
+        return NULL;
+    if (pv_is_time_type(type))
+        memcpy((char *)buf + pv_stamp_offsets[type - pvTypeTIME_CHAR],
+            &pv->stamp, sizeof(epicsTimeStamp));
+    vp = (char *)buf + pv_value_offsets[type];
+    for (n = 0; n < count; n++) {
+        double v = pv->value[n];
+
+        switch (base) {
+        case pvTypeCHAR:    ((pvChar *)vp)[n] = (pvChar)v; break;
+        case pvTypeSHORT:   ((pvShort *)vp)[n] = (pvShort)v; break;
+        case pvTypeLONG:    ((pvLong *)vp)[n] = (pvLong)v; break;
+        case pvTypeFLOAT:   ((pvFloat *)vp)[n] = (pvFloat)v; break;
+        case pvTypeDOUBLE:  ((pvDouble *)vp)[n] = v; break;
+        case pvTypeSTRING:  sprintf(((pvString *)vp)[n], "%.15g", v); break;
+        default:            break;
+        }
+    }
+    return buf;
+}
+
+/* Store a value of the given simple type in pv */
+static void loopPutValue(LOOPPV *pv, pvType type, unsigned count, pvValue *value)
+{
+    unsigned n;
+
+    for (n = 0; n < loopCount(pv, count); n++) {
+        double v = 0;
+
+        switch (type) {
+        case pvTypeCHAR:    v = ((pvChar *)value)[n]; break;
+        case pvTypeSHORT:   v = ((pvShort *)value)[n]; break;
+        case pvTypeLONG:    v = ((pvLong *)value)[n]; break;
+        case pvTypeFLOAT:   v = ((pvFloat *)value)[n]; break;
+        case pvTypeDOUBLE:  v = ((pvDouble *)value)[n]; break;
+        case pvTypeSTRING:  v = strtod(((pvString *)value)[n], NULL); break;
+        default:            break;
+        }
+        pv->value[n] = v;
+    }
+    epicsTimeGetCurrent(&pv->stamp);
+}
+
+static void loopQueue(LOOPSYS *sys, LOOPREQ *req)
+{
+    req->next = NULL;
+    if (sys->last)
+        sys->last->next = req;
+    else
+        sys->first = req;
+    sys->last = req;
+    epicsEventSignal(sys->wakeup);
+}
+
+static pvStat loopRequest(LOOPCHAN *chan, enum loop_req_kind kind,
+    LOOPMON *mon, void *arg, pvType type, unsigned count, pvValue *value)
+{
+    LOOPREQ *req = calloc(1, sizeof(LOOPREQ));
+
+    if (!req) {
+        free(value);
+        chan->var->msg = "out of memory";
+        return pvStatERROR;
+    }
+    req->kind = kind;
+    req->chan = chan;
+    req->mon = mon;
+    req->arg = arg;
+    req->type = type;
+    req->count = count;
+    req->value = value;
+    loopQueue(chan->sys, req);
+    return pvStatOK;
+}
+
+/* Remove queued requests for chan, or only those for mon if not NULL */
+static void loopCancel(LOOPSYS *sys, LOOPCHAN *chan, LOOPMON *mon)
+{
+    LOOPREQ **pp = &sys->first, *req;
+
+    sys->last = NULL;
+    while ((req = *pp)) {
+        if (req->chan == chan && (!mon || req->mon == mon)) {
+            *pp = req->next;
+            if (req->mon)
+                req->mon->pending = NULL;
+            free(req->value);
+            free(req);
+        } else {
+            sys->last = req;
+            pp = &req->next;
+        }
+    }
+}
+
+/* Post a monitor event for mon, or update the one not yet delivered */
+static void loopPostMon(LOOPMON *mon)
+{
+    LOOPPV *pv = mon->chan->pv;
+    unsigned count = loopCount(pv, mon->count);
+    pvValue *value = loopGetValue(pv, mon->type, count);
+
+    if (mon->pending) {
+        free(mon->pending->value);
+        mon->pending->value = value;
+    } else if (loopRequest(mon->chan, loopMonitor, mon, mon->arg,
+            mon->type, count, value) == pvStatOK) {
+        mon->pending = mon->chan->sys->last;
+    }
+}
+
+static void loopPost(LOOPPV *pv)
+{
+    LOOPCHAN *chan;
+    LOOPMON *mon;
+
+    for (chan = pv->chans; chan; chan = chan->next)
+        for (mon = chan->mons; mon; mon = mon->next)
+            loopPostMon(mon);
+}
+
+/* Generate due events, return seconds until the next one or -1 */
+static double loopGenerate(LOOPSYS *sys)
+{
+    double t = now(), wait = -1;
+    LOOPPV *pv;
+
+    for (pv = sys->pvs; pv; pv = pv->next) {
+        if (pv->rate <= 0)
+            continue;
+        if (pv->due <= t) {
+            /* catch up with events missed while we were busy */
+            double missed = (t - pv->due) * pv->rate;
+            unsigned n;
+
+            if (missed > 1e6)
+                missed = 1e6;
+            missed = (double)(unsigned)missed + 1;
+            for (n = 0; n < pv->count; n++)
+                pv->value[n] += missed;
+            epicsTimeGetCurrent(&pv->stamp);
+            pv->due += missed / pv->rate;
+            if (pv->due <= t)
+                pv->due = t + 1 / pv->rate;
+            loopPost(pv);
+        }
+        if (wait < 0 || pv->due - t < wait)
+            wait = pv->due - t;
+    }
+    return wait;
+}
+
+static void loopThread(void *arg)
+{
+    LOOPSYS *sys = (LOOPSYS *)arg;
+
+    epicsMutexMustLock(sys->lock);
+    for (;;) {
+        LOOPREQ *req;
+        double wait;
+
+        while ((req = sys->first)) {
+            pvVar *var = req->chan->var;
+
+            sys->first = req->next;
+            if (!sys->first)
+                sys->last = NULL;
+            if (req->mon)
+                req->mon->pending = NULL;
+            sys->busyChan = req->chan;
+            sys->busyMon = req->mon;
+            epicsMutexUnlock(sys->lock);
+
+            switch (req->kind) {
+            case loopConnect:
+                var->conn_handler(TRUE, var->arg);
+                break;
+            case loopGet:
+                var->event_handler(pvEventGet, req->arg, req->type,
+                    req->count, req->value, pvStatOK);
+                break;
+            case loopPut:
+                var->event_handler(pvEventPut, req->arg, req->type,
+                    req->count, NULL, pvStatOK);
+                break;
+            case loopMonitor:
+                var->event_handler(pvEventMonitor, req->arg, req->type,
+                    req->count, req->value, pvStatOK);
+                break;
+            }
+            free(req->value);
+            free(req);
+
+            epicsMutexMustLock(sys->lock);
+            sys->busyChan = NULL;
+            sys->busyMon = NULL;
+            epicsEventSignal(sys->idle);
+        }
+        wait = loopGenerate(sys);
+        if (sys->first)
+            continue;
+        epicsMutexUnlock(sys->lock);
+        if (wait < 0)
+            epicsEventMustWait(sys->wakeup);
+        else
+            epicsEventWaitWithTimeout(sys->wakeup, wait);
+        epicsMutexMustLock(sys->lock);
+    }
+}
+
+/* Wait until no callback for chan (or mon) is running, unless we are
+   called from inside it */
+static void loopWaitIdle(LOOPSYS *sys, LOOPCHAN *chan, LOOPMON *mon)
+{
+    if (epicsThreadGetIdSelf() == sys->thread)
+        return;
+    while (chan ? sys->busyChan == chan : sys->busyMon == mon) {
+        epicsMutexUnlock(sys->lock);
+        /* there may be more than one waiter, so poll */
+        epicsEventWaitWithTimeout(sys->idle, 0.01);
+        epicsMutexMustLock(sys->lock);
+    }
+}
+
+/* Free a partially created pv system */
+static void loopSysFree(LOOPSYS *sys)
+{
+    if (sys->idle)
+        epicsEventDestroy(sys->idle);
+    if (sys->wakeup)
+        epicsEventDestroy(sys->wakeup);
+    if (sys->lock)
+        epicsMutexDestroy(sys->lock);
+    free(sys);
+}
+
+static pvStat loopSysCreate(pvSystem *pSys)
+{
+    LOOPSYS *sys = calloc(1, sizeof(LOOPSYS));
+
+    if (!sys
+        || !(sys->lock = epicsMutexCreate())
+        || !(sys->wakeup = epicsEventCreate(epicsEventEmpty))
+        || !(sys->idle = epicsEventCreate(epicsEventEmpty))) {
+        if (sys)
+            loopSysFree(sys);
+        pSys->msg = "out of memory";
+        errlogSevPrintf(errlogFatal, "pvSysCreate(loop): out of memory\n");
+        return pvStatERROR;
+    }
+    sys->thread = epicsThreadCreate("pvLoop", epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackSmall), loopThread, sys);
+    if (!sys->thread) {
+        loopSysFree(sys);
+        pSys->msg = "cannot create thread";
+        errlogSevPrintf(errlogFatal, "pvSysCreate(loop): epicsThreadCreate failed\n");
+        return pvStatERROR;
+    }
+    pSys->id = sys;
+    return pvStatOK;
+}
+
+static pvStat loopSysFlush(pvSystem *pSys)
+{
+    return pvStatOK;
+}
+
+static pvStat loopSysAttach(pvSystem *pSys)
+{
+    return pvStatOK;
+}
+
+/* Parse the parameters after the '?' in a pv name */
+static pvStat loopParse(LOOPPV *pv, const char *params)
+{
+    while (params && *params) {
+        const char *end = strchr(params, '&');
+        int n = 0;
+
+        if (sscanf(params, "rate=%lf%n", &pv->rate, &n) == 1 ||
+            sscanf(params, "count=%u%n", &pv->count, &n) == 1) {
+            params += n;
+        }
+        if (!n || (*params && *params != '&'))
+            return pvStatERROR;
+        params = end ? end + 1 : NULL;
+    }
+    return pvStatOK;
+}
+
+static LOOPPV *loopPvCreate(LOOPSYS *sys, const char *name, pvVar *var)
+{
+    LOOPPV *pv = calloc(1, sizeof(LOOPPV));
+
+    if (!pv || !(pv->name = epicsStrDup(name))) {
+        free(pv);
+        var->msg = "out of memory";
+        return NULL;
+    }
+    pv->count = 1;
+    if (loopParse(pv, strchr(name, '?') ? strchr(name, '?') + 1 : NULL)
+            != pvStatOK || pv->count == 0 || pv->rate < 0) {
+        var->msg = "bad loopback pv parameters";
+        errlogSevPrintf(errlogMajor, "pvVarCreate(loop): bad parameters in pv name '%s'\n", name);
+        free(pv->name);
+        free(pv);
+        return NULL;
+    }
+    pv->value = calloc(pv->count, sizeof(double));
+    if (!pv->value) {
+        var->msg = "out of memory";
+        free(pv->name);
+        free(pv);
+        return NULL;
+    }
+    epicsTimeGetCurrent(&pv->stamp);
+    if (pv->rate > 0) {
+        pv->due = now() + 1 / pv->rate;
+        epicsEventSignal(sys->wakeup);
+    }
+    pv->next = sys->pvs;
+    sys->pvs = pv;
+    return pv;
+}
+
+static pvStat loopVarCreate(pvSystem *pSys, const char *name, pvVar *var)
+{
+    LOOPSYS *sys = (LOOPSYS *)pSys->id;
+    LOOPCHAN *chan = calloc(1, sizeof(LOOPCHAN));
+    LOOPPV *pv;
+
+    if (!chan) {
+        var->msg = "out of memory";
+        return pvStatERROR;
+    }
+    epicsMutexMustLock(sys->lock);
+    for (pv = sys->pvs; pv; pv = pv->next) {
+        if (strcmp(pv->name, name) == 0)
+            break;
+    }
+    if (!pv)
+        pv = loopPvCreate(sys, name, var);
+    if (!pv) {
+        epicsMutexUnlock(sys->lock);
+        free(chan);
+        return pvStatERROR;
+    }
+    chan->sys = sys;
+    chan->pv = pv;
+    chan->var = var;
+    chan->next = pv->chans;
+    pv->chans = chan;
+    var->chid = chan;
+    loopRequest(chan, loopConnect, NULL, NULL, pvTypeERROR, 0, NULL);
+    epicsMutexUnlock(sys->lock);
+    return pvStatOK;
+}
+
+static pvStat loopVarDestroy(pvVar *var)
+{
+    LOOPCHAN *chan = (LOOPCHAN *)var->chid, **pc;
+    LOOPSYS *sys = chan->sys;
+    LOOPPV *pv = chan->pv, **pp;
+
+    epicsMutexMustLock(sys->lock);
+    /* no more monitors once unlinked, then cancel what the callback
+       we waited for may have requested */
+    for (pc = &pv->chans; *pc != chan; pc = &(*pc)->next)
+        ;
+    *pc = chan->next;
+    loopWaitIdle(sys, chan, NULL);
+    loopCancel(sys, chan, NULL);
+    while (chan->mons) {
+        LOOPMON *mon = chan->mons;
+
+        chan->mons = mon->next;
+        free(mon);
+    }
+    free(chan);
+    if (!pv->chans) {
+        for (pp = &sys->pvs; *pp != pv; pp = &(*pp)->next)
+            ;
+        *pp = pv->next;
+        free(pv->value);
+        free(pv->name);
+        free(pv);
+    }
+    epicsMutexUnlock(sys->lock);
+    return pvStatOK;
+}
+
+static pvStat loopVarGetCallback(pvVar *var, pvType type, unsigned count, void *arg)
+{
+    LOOPCHAN *chan = (LOOPCHAN *)var->chid;
+    pvValue *value;
+    pvStat status;
+
+    epicsMutexMustLock(chan->sys->lock);
+    count = loopCount(chan->pv, count);
+    value = loopGetValue(chan->pv, type, count);
+    if (value) {
+        status = loopRequest(chan, loopGet, NULL, arg, type, count, value);
+    } else {
+        var->msg = "out of memory";
+        status = pvStatERROR;
+    }
+    epicsMutexUnlock(chan->sys->lock);
+    return status;
+}
+
+static pvStat loopVarPutNoBlock(pvVar *var, pvType type, unsigned count, pvValue *value)
+{
+    LOOPCHAN *chan = (LOOPCHAN *)var->chid;
+
+    epicsMutexMustLock(chan->sys->lock);
+    loopPutValue(chan->pv, type, count, value);
+    loopPost(chan->pv);
+    epicsMutexUnlock(chan->sys->lock);
+    return pvStatOK;
+}
+
+static pvStat loopVarPutCallback(pvVar *var, pvType type, unsigned count, pvValue *value, void *arg)
+{
+    LOOPCHAN *chan = (LOOPCHAN *)var->chid;
+    pvStat status;
+
+    epicsMutexMustLock(chan->sys->lock);
+    loopPutValue(chan->pv, type, count, value);
+    loopPost(chan->pv);
+    status = loopRequest(chan, loopPut, NULL, arg, type, count, NULL);
+    epicsMutexUnlock(chan->sys->lock);
+    return status;
+}
+
+static pvStat loopVarMonitorOn(pvVar *var, pvType type, unsigned count, void *arg)
+{
+    LOOPCHAN *chan = (LOOPCHAN *)var->chid;
+    LOOPMON *mon = calloc(1, sizeof(LOOPMON));
+
+    if (!mon) {
+        var->msg = "out of memory";
+        return pvStatERROR;
+    }
+    mon->chan = chan;
+    mon->type = type;
+    mon->count = count;
+    mon->arg = arg;
+    epicsMutexMustLock(chan->sys->lock);
+    mon->next = chan->mons;
+    chan->mons = mon;
+    var->monid = mon;
+    /* like CA, send the current value first */
+    loopPostMon(mon);
+    epicsMutexUnlock(chan->sys->lock);
+    return pvStatOK;
+}
+
+static pvStat loopVarMonitorOff(pvVar *var)
+{
+    LOOPMON *mon = (LOOPMON *)var->monid, **pm;
+    LOOPCHAN *chan = mon->chan;
+    LOOPSYS *sys = chan->sys;
+
+    epicsMutexMustLock(sys->lock);
+    for (pm = &chan->mons; *pm != mon; pm = &(*pm)->next)
+        ;
+    *pm = mon->next;
+    loopWaitIdle(sys, NULL, mon);
+    loopCancel(sys, chan, mon);
+    free(mon);
+    epicsMutexUnlock(sys->lock);
+    return pvStatOK;
+}
+
+static unsigned loopVarGetCount(pvVar *var)
+{
+    LOOPCHAN *chan = (LOOPCHAN *)var->chid;
+
+    return chan->pv->count;
+}
+
+epicsShareDef const pvBackend pvBackendLoop = {
+    "loop",
+    loopSysCreate,
+    loopSysFlush,
+    loopSysAttach,
+    loopVarCreate,
+    loopVarDestroy,
+    loopVarGetCallback,
+    loopVarPutNoBlock,
+    loopVarPutCallback,
+    loopVarMonitorOn,
+    loopVarMonitorOff,
+    loopVarGetCount
+};
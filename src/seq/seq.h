@@ -47,6 +47,7 @@ in the file LICENSE that is included with this distribution.
 #include "epicsString.h"
 #include "epicsThread.h"
 #include "epicsTime.h"
+#include "epicsTimer.h"
 #include "errlog.h"
 #include "freeList.h"
 #include "iocsh.h"
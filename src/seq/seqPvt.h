@@ -37,11 +37,18 @@ in the file LICENSE that is included with this distribution.
 #define boolean seqBool
 #define bitMask seqMask
 
+#include "seq_atomic.h"
 #include "seq_queue.h"
 
-#define valPtr(ch,ss)		((char*)(ss)->var+(ch)->offset)
+/* In safe mode, a state set's var may hold only the channels it uses */
+#define NO_OFFSET		((size_t)-1)
+#define valOffset(ch,ss)	((ss)->chanOffset?(ss)->chanOffset[chNum(ch)]:(ch)->offset)
+#define hasVal(ch,ss)		(valOffset(ch,ss)!=NO_OFFSET)
+#define valPtr(ch,ss)		((char*)(ss)->var+valOffset(ch,ss))
 #define bufPtr(ch)		((char*)(ch)->prog->var+(ch)->offset)
 
+#define syncedMask(sp,ef)	((sp)->syncedChans+(ef)*NWORDS((sp)->numChans))
+
 #define ssNum(ss)		((ss)-(ss)->prog->ss)
 #define chNum(ch)		((ch)-(ch)->prog->chan)
 
@@ -53,6 +60,13 @@ in the file LICENSE that is included with this distribution.
 	:0					\
 )
 
+/* Index of the lowest set bit in a non-zero bitMask word */
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+#define bitFirstSet(word)	((unsigned)__builtin_ctz(word))
+#else
+#define bitFirstSet(word)	seqMaskFirstSet(word)
+#endif
+
 #define optTest(sp,opt)		(((sp)->options & (opt)) != 0)
 					/* test if opt is set in program instance sp */
 
@@ -81,6 +95,9 @@ typedef struct macro		MACRO;
 typedef struct state_set	SSCB;
 typedef struct program_instance	PROG;
 typedef struct pvreq		PVREQ;
+typedef struct shared_pv	SHAREDPV;
+typedef struct shared_monitor	SHAREDMON;
+typedef struct worker_pool	POOL;
 typedef const struct pv_type	PVTYPE;
 typedef struct pv_meta_data	PVMETA;
 
@@ -100,12 +117,21 @@ struct channel
 	/* dynamic channel data (assigned at runtime) */
 	DBCHAN		*dbch;		/* channel assigned to a named db pv */
 	EF_ID		syncedTo;	/* event flag id if synced */
-	CHAN		*nextSynced;	/* next channel synced to same flag */
 	QUEUE		queue;		/* queue if queued */
+	enum syncqPolicy queuePolicy;	/* what to do if queue is full */
+	boolean		queueBytes;	/* queue stores only received elements */
+	unsigned	queueWatermark;	/* defer wakeups until this many queued */
+	double		queueTimeout;	/* ...or this many seconds passed */
+	epicsTimerId	queueTimer;	/* timer for queueTimeout (or NULL) */
+	volatile epicsUInt32 queueTimerArmed; /* whether queueTimer is running */
 	boolean		monitored;	/* whether channel is monitored */
+	CHAN		*nextUser;	/* next channel using the same shared PV */
+	CHAN		*nextMonUser;	/* next channel using the same monitor */
 	/* buffer access, only used in safe mode */
 	epicsMutexId	varLock;	/* mutex for locking access to shared
 					   var buffer and meta data */
+	volatile epicsUInt32 bufSeq;	/* sequence number for lock-free access
+					   to shared buffer (odd while writing) */
 };
 
 struct pv_type
@@ -130,9 +156,12 @@ struct db_channel
 {
 	char		*dbName;	/* channel name after macro expansion */
 	pvVar		pvid;		/* PV (process variable) id */
+	SHAREDPV	*pv;		/* shared PV, see seq_pvreg.c */
+	SHAREDMON	*mon;		/* shared monitor (or NULL) */
 	unsigned	dbCount;	/* actual count for db access */
 	boolean		connected;	/* whether channel is connected */
-	boolean		gotMonitor;	/* whether we got a monitor after connect */
+	volatile epicsUInt32 gotMonitor;/* whether we got a monitor after connect
+					   (atomic modification only) */
 	PVMETA		metaData;	/* meta data (shared buffer) */
 };
 
@@ -151,17 +180,42 @@ struct state_set
 	int		currentState;	/* current state index, -1 if none */
 	int		nextState;	/* next state index, -1 if none */
 	int		prevState;	/* previous state index, -1 if none */
-	const bitMask	*mask;		/* current event mask */
+	const bitMask	*volatile mask;	/* current event mask (read by
+					   ss_wakeup without locking) */
 	double		timeEntered;	/* time that current state was entered */
 	double		wakeupTime;	/* next time state set should wake up */
+	double		evalTime;	/* time of current evaluation (0 if not
+					   yet known) */
+	epicsTimerId	wakeupTimer;	/* timer for wakeupTime */
+	double		timerTime;	/* expiration time of wakeupTimer */
+	boolean		timerArmed;	/* whether wakeupTimer is running (only
+					   written when running the state set) */
+	volatile epicsUInt32 timerExpired;/* set by the timer callback (atomic
+					   modification only) */
 	epicsEventId	syncSem;	/* semaphore for event sync */
+	bitMask		*pending;	/* events that arrived since last
+					   evaluation (atomic access only) */
+	bitMask		*changed;	/* events taken from pending since the
+					   conditions were last evaluated */
 	epicsEventId	dead;		/* event to signal state set exit done */
+	volatile epicsUInt32 poolState;	/* see seq_pool.c (atomic access only) */
+	SSCB		*poolNext;	/* next on the pool's ready queue */
 	/* these are arrays, one for each channel */
 	PVREQ		**getReq;	/* currently pending get requests */
 	PVREQ		**putReq;	/* currently pending put requests */
 	PVMETA		*metaData;	/* meta data (safe mode) */
 	/* safe mode */
-	boolean		*dirty;		/* array of flags, one for each channel */
+	bitMask		*dirty;		/* dirty bits, one for each channel
+					   (atomic modification only) */
+	bitMask		*getDone;	/* get completed but value not yet
+					   copied, one for each channel
+					   (atomic modification only) */
+	boolean		varSubset;	/* var holds only the varFields */
+	seqVarField	*varFields;	/* variables in var if varSubset */
+	unsigned	numVarFields;	/* number of varFields */
+	size_t		varSize;	/* size of var */
+	size_t		*chanOffset;	/* offset of each channel's value
+					   in var (or NULL if as in prog->var) */
 };
 
 STATIC_ASSERT(offsetof(struct state_set,var)==0);
@@ -175,6 +229,8 @@ struct program_instance
 	int		instance;	/* program instance number */
 	unsigned	threadPriority;	/* thread priority (all threads) */
 	unsigned	stackSize;	/* stack size (all threads) */
+	boolean		pooled;		/* state sets run in the worker pool */
+	POOL		*pool;		/* the pool for our pv system */
 	pvSystem	pvSys;		/* pv system handle */
 	CHAN		*chan;		/* table of channels */
 	unsigned	numChans;	/* number of channels */
@@ -192,15 +248,22 @@ struct program_instance
 	unsigned	numEvFlags;	/* number of event flags */
 
 	/* dynamic program data (assigned at runtime) */
-	epicsMutexId	lock;	/* mutex for locking dynamic program data */
-	/* the following five members must always be protected by lock */
-	bitMask		*evFlags;	/* event bits for event flags & channels */
-	CHAN		**syncedChans;	/* for each event flag, start of synced list */
-	unsigned	assignCount;	/* number of channels assigned to ext. pv */
-	unsigned	connectCount;	/* number of channels connected */
-	unsigned	monitorCount;	/* number of channels monitored */
-	unsigned	gotMonitorCount;/* number of monitored channels that got
+	epicsTimerQueueId timerQueue;	/* shared queue for wakeup timers */
+	epicsMutexId	lock;	/* mutex for channel assignment and
+				   connection state */
+	bitMask		*evFlags;	/* event bits for event flags (atomic
+					   modification only) */
+	bitMask		*syncedChans;	/* for each event flag, mask of synced
+					   channels (modified under lock, read
+					   without, see syncedMask) */
+	/* the following counters are modified atomically */
+	volatile unsigned assignCount;	/* number of channels assigned to ext. pv */
+	volatile unsigned connectCount;	/* number of channels connected */
+	volatile unsigned monitorCount;	/* number of channels monitored */
+	volatile unsigned gotMonitorCount;/* number of monitored channels that got
 					   a monitor event */
+	volatile unsigned queueWriters;	/* number of state sets waiting for
+					   space in a queue with policy block */
 
 	void		*pvReqPool;	/* freeList for pv requests (has own lock) */
 	boolean		die;		/* flag set when seqStop is called */
@@ -226,11 +289,29 @@ struct pvreq
 /* Internal procedures */
 
 /* seq_task.c */
+unsigned seqMaskFirstSet(bitMask word);
 void sequencer(void *arg);
-void ss_write_buffer(CHAN *ch, void *val, PVMETA *meta, boolean dirtify);
+boolean ss_write_buffer(CHAN *ch, void *val, PVMETA *meta, boolean dirtify);
 void ss_read_buffer(SSCB *ss, CHAN *ch, boolean dirty_only);
 void ss_read_buffer_selective(PROG *sp, SSCB *ss, EF_ID ev_flag);
 void ss_wakeup(PROG *sp, unsigned eventNum);
+void ss_signal(SSCB *ss);
+void ss_timer_expired(void *arg);
+boolean ss_queue_defer(CHAN *ch);
+void ss_queue_timer_expired(void *arg);
+enum ss_step { SS_STEP_IDLE, SS_STEP_AGAIN, SS_STEP_EXIT };
+enum ss_step ss_pool_step(SSCB *ss);
+
+/* seq_pool.c */
+void seqPoolStart(PROG *sp);
+void seqPoolWakeup(SSCB *ss);
+
+/* seq_pvreg.c */
+pvStat seqPvCreate(CHAN *ch);
+pvStat seqPvDestroy(CHAN *ch, DBCHAN *dbch);
+pvStat seqPvMonitorOn(CHAN *ch);
+pvStat seqPvMonitorOff(CHAN *ch);
+const char *seqPvGetMess(CHAN *ch);
 
 /* seq_mac.c */
 void seqMacParse(PROG *sp, const char *macStr);
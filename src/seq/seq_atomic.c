@@ -0,0 +1,128 @@
+/*************************************************************************\
+Copyright (c) 2010-2015 Helmholtz-Zentrum Berlin f. Materialien
+                        und Energie GmbH, Germany (HZB)
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*************************************************************************\
+    Backoff for lock-free retry loops, and emulation of atomic operations
+                         using a global mutex
+\*************************************************************************/
+#include "seq.h"
+
+void seqAtomicBackoff(unsigned *spins)
+{
+	/* Only yield at first; later sleep, so that a preempted thread
+	   with lower priority gets the chance to finish. */
+	if (++*spins < 100)
+		epicsThreadSleep(0.0);
+	else
+		epicsThreadSleep(epicsThreadSleepQuantum());
+}
+
+#if defined(SEQ_ATOMIC_EMULATED) || defined(SEQ_ATOMIC64_EMULATED)
+
+static epicsThreadOnceId atomicOnce = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId atomicLock;
+
+static void atomicInit(void *arg)
+{
+	atomicLock = epicsMutexMustCreate();
+}
+
+static void atomicLockTake(void)
+{
+	epicsThreadOnce(&atomicOnce, atomicInit, NULL);
+	epicsMutexMustLock(atomicLock);
+}
+
+#endif
+
+#ifdef SEQ_ATOMIC_EMULATED
+
+epicsUInt32 seqAtomicAdd(volatile epicsUInt32 *p, epicsUInt32 v)
+{
+	epicsUInt32 old;
+
+	atomicLockTake();
+	old = *p;
+	*p = old + v;
+	epicsMutexUnlock(atomicLock);
+	return old;
+}
+
+epicsUInt32 seqAtomicOr(volatile epicsUInt32 *p, epicsUInt32 v)
+{
+	epicsUInt32 old;
+
+	atomicLockTake();
+	old = *p;
+	*p = old | v;
+	epicsMutexUnlock(atomicLock);
+	return old;
+}
+
+epicsUInt32 seqAtomicAnd(volatile epicsUInt32 *p, epicsUInt32 v)
+{
+	epicsUInt32 old;
+
+	atomicLockTake();
+	old = *p;
+	*p = old & v;
+	epicsMutexUnlock(atomicLock);
+	return old;
+}
+
+epicsUInt32 seqAtomicCas(volatile epicsUInt32 *p, epicsUInt32 o, epicsUInt32 n)
+{
+	epicsUInt32 old;
+
+	atomicLockTake();
+	old = *p;
+	if (old == o)
+		*p = n;
+	epicsMutexUnlock(atomicLock);
+	return old;
+}
+
+void seqAtomicBarrier(void)
+{
+	/* taking and releasing a mutex implies a full barrier */
+	atomicLockTake();
+	epicsMutexUnlock(atomicLock);
+}
+
+#endif /* SEQ_ATOMIC_EMULATED */
+
+#ifdef SEQ_ATOMIC64_EMULATED
+
+seqUInt64 seqAtomicLoad64(volatile seqUInt64 *p)
+{
+	seqUInt64 v;
+
+	atomicLockTake();
+	v = *p;
+	epicsMutexUnlock(atomicLock);
+	return v;
+}
+
+void seqAtomicStore64(volatile seqUInt64 *p, seqUInt64 v)
+{
+	atomicLockTake();
+	*p = v;
+	epicsMutexUnlock(atomicLock);
+}
+
+seqUInt64 seqAtomicCas64(volatile seqUInt64 *p, seqUInt64 o, seqUInt64 n)
+{
+	seqUInt64 old;
+
+	atomicLockTake();
+	old = *p;
+	if (old == o)
+		*p = n;
+	epicsMutexUnlock(atomicLock);
+	return old;
+}
+
+#endif /* SEQ_ATOMIC64_EMULATED */
@@ -0,0 +1,94 @@
+/*************************************************************************\
+Copyright (c) 2010-2015 Helmholtz-Zentrum Berlin f. Materialien
+                        und Energie GmbH, Germany (HZB)
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*************************************************************************\
+Minimal set of atomic operations used by the run-time sequencer.
+
+EPICS base 3.14 has no epicsAtomic.h, so we provide our own. All
+read-modify-write operations return the previous value and imply a
+full memory barrier; seqAtomicCas(p,o,n) stores n in *p only if *p
+equals o. Where the compiler offers no suitable intrinsics, they are
+emulated with a single global mutex (see seq_atomic.c).
+
+The 64 bit operations are separate, since some targets have 32 bit
+atomics but no 64 bit ones. seqAtomicLoad64 has acquire and
+seqAtomicStore64 release semantics.
+\*************************************************************************/
+#ifndef INCLseq_atomich
+#define INCLseq_atomich
+
+#include "epicsTypes.h"
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+
+#define seqAtomicAdd(p,v)	__sync_fetch_and_add(p,v)
+#define seqAtomicOr(p,v)	__sync_fetch_and_or(p,v)
+#define seqAtomicAnd(p,v)	__sync_fetch_and_and(p,v)
+#define seqAtomicCas(p,o,n)	__sync_val_compare_and_swap(p,o,n)
+#define seqAtomicBarrier()	__sync_synchronize()
+
+#elif defined(_MSC_VER)
+
+#include <intrin.h>
+#pragma intrinsic(_InterlockedExchangeAdd, _InterlockedOr, _InterlockedAnd, _InterlockedCompareExchange, _mm_mfence)
+
+#define seqAtomicAdd(p,v)	((epicsUInt32)_InterlockedExchangeAdd((volatile long *)(p),(long)(v)))
+#define seqAtomicOr(p,v)	((epicsUInt32)_InterlockedOr((volatile long *)(p),(long)(v)))
+#define seqAtomicAnd(p,v)	((epicsUInt32)_InterlockedAnd((volatile long *)(p),(long)(v)))
+#define seqAtomicCas(p,o,n)	((epicsUInt32)_InterlockedCompareExchange((volatile long *)(p),(long)(n),(long)(o)))
+#define seqAtomicBarrier()	_mm_mfence()
+
+#else
+
+#define SEQ_ATOMIC_EMULATED
+
+epicsUInt32 seqAtomicAdd(volatile epicsUInt32 *p, epicsUInt32 v);
+epicsUInt32 seqAtomicOr(volatile epicsUInt32 *p, epicsUInt32 v);
+epicsUInt32 seqAtomicAnd(volatile epicsUInt32 *p, epicsUInt32 v);
+epicsUInt32 seqAtomicCas(volatile epicsUInt32 *p, epicsUInt32 o, epicsUInt32 n);
+void seqAtomicBarrier(void);
+
+#endif
+
+#define seqAtomicInc(p)	seqAtomicAdd(p,1u)
+#define seqAtomicDec(p)	seqAtomicAdd(p,~0u)
+
+typedef unsigned long long seqUInt64;
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)) \
+	&& (__SIZEOF_POINTER__ >= 8 || defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8))
+
+#define seqAtomicLoad64(p)	__atomic_load_n(p,__ATOMIC_ACQUIRE)
+#define seqAtomicStore64(p,v)	__atomic_store_n(p,v,__ATOMIC_RELEASE)
+#define seqAtomicCas64(p,o,n)	__sync_val_compare_and_swap(p,o,n)
+
+#elif defined(_MSC_VER) && defined(_WIN64)
+
+#pragma intrinsic(_InterlockedCompareExchange64)
+
+/* volatile accesses have acquire/release semantics with MSVC */
+#define seqAtomicLoad64(p)	(*(volatile seqUInt64 *)(p))
+#define seqAtomicStore64(p,v)	(*(volatile seqUInt64 *)(p) = (v))
+#define seqAtomicCas64(p,o,n)	((seqUInt64)_InterlockedCompareExchange64((volatile __int64 *)(p),(__int64)(n),(__int64)(o)))
+
+#else
+
+#define SEQ_ATOMIC64_EMULATED
+
+seqUInt64 seqAtomicLoad64(volatile seqUInt64 *p);
+void seqAtomicStore64(volatile seqUInt64 *p, seqUInt64 v);
+seqUInt64 seqAtomicCas64(volatile seqUInt64 *p, seqUInt64 o, seqUInt64 n);
+
+#endif
+
+/* Wait a little before retrying an operation that lost a race */
+void seqAtomicBackoff(unsigned *spins);
+
+/* Atomic versions of bitSet and bitClear from seq_mask.h */
+#define bitSetAtomic(words, bitnum)	seqAtomicOr((words)+(bitnum)/NBITS, 1u<<((bitnum)%NBITS))
+#define bitClearAtomic(words, bitnum)	seqAtomicAnd((words)+(bitnum)/NBITS, ~(1u<<((bitnum)%NBITS)))
+
+#endif /* INCLseq_atomich */
@@ -36,6 +36,7 @@ in the file LICENSE that is included with this distribution.
 static void proc_db_events(
 	pvValue		*value,	/* ptr to value */
 	pvType		type,	/* type of value */
+	unsigned	count,	/* number of elements in value */
 	CHAN		*ch,	/* channel object */
 	SSCB		*ss,	/* originator, for put and get, else 0 */
 	pvEventType	evtype,	/* put, get, or monitor */
@@ -54,7 +55,11 @@ pvStat seq_connect(PROG *sp, boolean wait)
 	boolean		ready = FALSE;
 
 	/*
-	 * For each channel: create pv object, then subscribe if monitored.
+	 * For each channel: create pv object, and subscribe if monitored
+	 * (see seqPvCreate). Subscribing does not have to wait for the
+	 * connection, the pv layer installs it as soon as the channel
+	 * connects. So all requests go out in one batch with a single
+	 * flush, rather than one monitor request per connection callback.
 	 */
 	for (nch = 0; nch < sp->numChans; nch++)
 	{
@@ -65,14 +70,8 @@ pvStat seq_connect(PROG *sp, boolean wait)
 			continue; /* skip records without pv names */
 		DEBUG("seq_connect: connect %s to %s\n", ch->varName,
 			dbch->dbName);
-		/* Connect to it */
-		status = pvVarCreate(
-				sp->pvSys,		/* PV system context */
-				ch->dbch->dbName,	/* PV name */
-				seq_conn_handler,	/* connection handler routine */
-				seq_event_handler,	/* event handler routine */
-				ch,			/* private data is CHAN struc */
-				&dbch->pvid);		/* ptr to PV id */
+		/* Connect to it, or share the channel with others */
+		status = seqPvCreate(ch);
 		if (status != pvStatOK)
 		{
 			errlogSevPrintf(errlogFatal, "seq_connect(var '%s', pv '%s'): pvVarCreate() failure: "
@@ -97,12 +96,10 @@ pvStat seq_connect(PROG *sp, boolean wait)
 			if (sp->die)
 				return pvStatERROR;
 
-			epicsMutexMustLock(sp->lock);
 			ac = sp->assignCount;
 			mc = sp->monitorCount;
 			cc = sp->connectCount;
 			gmc = sp->gotMonitorCount;
-			epicsMutexUnlock(sp->lock);
 
 			ready = ac == cc && mc == gmc;
 			if (!ready)
@@ -138,6 +135,21 @@ pvStat seq_connect(PROG *sp, boolean wait)
 	return pvStatOK;
 }
 
+/*
+ * check_ready() - Signal sp->ready if all channels are connected
+ * and have received their first monitor. Must be called after the
+ * (atomic) counter update, so that of two concurrent updates at
+ * least one sees the other.
+ */
+static void check_ready(PROG *sp)
+{
+	if (sp->gotMonitorCount == sp->monitorCount
+		&& sp->connectCount == sp->assignCount)
+	{
+		epicsEventSignal(sp->ready);
+	}
+}
+
 /*
  * seq_get_handler() - Sequencer callback handler.
  * Called when a "get" completes.
@@ -153,7 +165,7 @@ static void seq_get_handler(
 	freeListFree(sp->pvReqPool, arg);
 	/* ignore callback if not expected, e.g. already timed out */
 	if (ss->getReq[chNum(ch)] == rq)
-		proc_db_events(value, type, ch, ss, pvEventGet, status);
+		proc_db_events(value, type, count, ch, ss, pvEventGet, status);
 }
 
 /*
@@ -171,7 +183,7 @@ static void seq_put_handler(
 	freeListFree(sp->pvReqPool, arg);
 	/* ignore callback if not expected, e.g. already timed out */
 	if (ss->putReq[chNum(ch)] == rq)
-		proc_db_events(value, type, ch, ss, pvEventPut, status);
+		proc_db_events(value, type, count, ch, ss, pvEventPut, status);
 }
 
 /*
@@ -181,21 +193,8 @@ static void seq_mon_handler(
 	pvType type, unsigned count, pvValue *value, void *arg, pvStat status)
 {
 	CHAN	*ch = (CHAN *)arg;
-	PROG	*sp = ch->prog;
 
-	proc_db_events(value, type, ch, 0, pvEventMonitor, status);
-	epicsMutexMustLock(sp->lock);
-	if (ch->dbch && !ch->dbch->gotMonitor)
-	{
-		ch->dbch->gotMonitor = TRUE;
-		sp->gotMonitorCount++;
-		if (sp->gotMonitorCount == sp->monitorCount
-			&& sp->connectCount == sp->assignCount)
-		{
-			epicsEventSignal(sp->ready);
-		}
-	}
-	epicsMutexUnlock(sp->lock);
+	proc_db_events(value, type, count, ch, 0, pvEventMonitor, status);
 }
 
 /*
@@ -223,19 +222,18 @@ struct putq_cp_arg {
 	void	*value;
 };
 
-static void *putq_cp(void *dest, const void *src, size_t elemSize)
+static void *putq_cp(void *dest, const void *src, size_t size)
 {
 	struct putq_cp_arg *arg = (struct putq_cp_arg *)src;
-	CHAN *ch = arg->ch;
 
-	return memcpy(dest, arg->value,
-		pv_size_n(ch->type->getType, ch->dbch->dbCount));
+	return memcpy(dest, arg->value, size);
 }
 
 /* Common code for completion and monitor handling */
 static void proc_db_events(
 	pvValue		*value,
 	pvType		type,
+	unsigned	count,
 	CHAN		*ch,
 	SSCB		*ss,
 	pvEventType	evtype,
@@ -244,11 +242,24 @@ static void proc_db_events(
 {
 	PROG	*sp = ch->prog;
 	static const char *event_type_name[] = {"get","put","mon"};
-
-	epicsMutexMustLock(sp->lock);
+	boolean	unread = FALSE, deferred = FALSE;
+	EF_ID	syncedTo = ch->syncedTo;
+	/* Counters, event flags and synced masks need no lock. Two things
+	   still do. In safe mode, seq_efTestAndClear relies on the new
+	   value of a synced channel and its event flag to appear together,
+	   so it does not clear the flag but miss the value. And get and
+	   put completions may race with seq_pvAssign freeing ch->dbch;
+	   monitors cannot, because seqPvDestroy unsubscribes ch under the
+	   PV's lock, which is held while calling us. */
+	boolean	locked = evtype != pvEventMonitor
+		|| (optTest(sp, OPT_SAFE) && syncedTo);
+
+	if (locked)
+		epicsMutexMustLock(sp->lock);
 
 	if (!ch->dbch) {
-		epicsMutexUnlock(sp->lock);
+		if (locked)
+			epicsMutexUnlock(sp->lock);
 		return;
 	}
 
@@ -261,17 +272,22 @@ static void proc_db_events(
 		boolean	full;
 		struct putq_cp_arg arg = {ch, value};
 
+		if (count > ch->dbch->dbCount)
+			count = ch->dbch->dbCount;
+
 		DEBUG("proc_db_events: var=%s, pv=%s, queue=%p, used(max)=%d(%d)\n",
 			ch->varName, ch->dbch->dbName,
 			ch->queue, seqQueueUsed(ch->queue), seqQueueNumElems(ch->queue));
 		/* Copy whole message into queue; no need to lock against other
 		   writers, because named and anonymous PVs are disjoint. */
-		full = seqQueuePutF(ch->queue, putq_cp, &arg);
-		if (full)
+		full = seqQueuePutSizeF(ch->queue, putq_cp, &arg, pv_size_n(type, count));
+		deferred = ss_queue_defer(ch);
+		/* Report only the first loss, seqQueueShow has the counters */
+		if (full && seqQueueNumDropped(ch->queue) == 1)
 		{
 			errlogSevPrintf(errlogMinor,
 			  "monitor event for variable '%s' (pv '%s'): "
-			  "last queue element overwritten (queue is full)\n",
+			  "queue is full, further losses are not reported\n",
 			  ch->varName, ch->dbch->dbName
 			);
 		}
@@ -293,14 +309,40 @@ static void proc_db_events(
 		/* Set error message only when severity indicates error */
 		if (meta.severity != pvSevrNONE)
 		{
-			const char *pmsg = pvVarGetMess(ch->dbch->pvid);
+			const char *pmsg = seqPvGetMess(ch);
 			if (!pmsg) pmsg = "unknown";
 			meta.message = pmsg;
 		}
 
 		/* Write value and meta data to shared buffers.
 		   Set the dirty flag only if this was a monitor event. */
-		ss_write_buffer(ch, val, &meta, evtype == pvEventMonitor);
+		unread = ss_write_buffer(ch, val, &meta, evtype == pvEventMonitor);
+	}
+
+	if (evtype == pvEventMonitor
+		&& !seqAtomicCas(&ch->dbch->gotMonitor, 0u, 1u))
+	{
+		seqAtomicInc(&sp->gotMonitorCount);
+		check_ready(sp);
+	}
+
+	/* With option +b, a monitor that arrives before any state set has
+	   read the previous one is merged with it: the new value replaces
+	   the old one, but state sets have already been woken up and the
+	   event flag set, so there is nothing else to do. */
+	if (unread && optTest(sp, OPT_BATCH))
+	{
+		if (locked)
+			epicsMutexUnlock(sp->lock);
+		return;
+	}
+
+	/* A queue below its wakeup watermark wakes up nobody (yet) */
+	if (deferred)
+	{
+		if (locked)
+			epicsMutexUnlock(sp->lock);
+		return;
 	}
 
 	/* Signal completion */
@@ -308,11 +350,15 @@ static void proc_db_events(
 	{
 	case pvEventPut:
 		ss->putReq[chNum(ch)] = NULL;
-		epicsEventSignal(ss->syncSem);
+		ss_signal(ss);
 		break;
 	case pvEventGet:
+		/* Tell pvGetComplete there is a new value to copy
+		   (must happen before the request is marked done) */
+		if (optTest(sp, OPT_SAFE))
+			bitSetAtomic(ss->getDone, chNum(ch));
 		ss->getReq[chNum(ch)] = NULL;
-		epicsEventSignal(ss->syncSem);
+		ss_signal(ss);
 		if (optTest(sp, OPT_SAFE))
 			break;
 		/* else: fall through */
@@ -325,10 +371,11 @@ static void proc_db_events(
 	}
 
 	/* If there's an event flag associated with this channel, set it */
-	if (ch->syncedTo)
-		seq_efSet(sp->ss, ch->syncedTo);
+	if (syncedTo)
+		seq_efSet(sp->ss, syncedTo);
 
-	epicsMutexUnlock(sp->lock);
+	if (locked)
+		epicsMutexUnlock(sp->lock);
 }
 
 /* Disconnect all database channels */
@@ -351,9 +398,9 @@ void seq_disconnect(PROG *sp)
 			ch->varName, dbch->dbName);
 		/* Disconnect this PV */
 		epicsMutexUnlock(sp->lock);
-		/* Note: must unlock around pvVarDestroy to avoid deadlock
+		/* Note: must unlock around seqPvDestroy to avoid deadlock
 		   with pending callbacks. */
-		status = pvVarDestroy(&dbch->pvid);
+		status = seqPvDestroy(ch, dbch);
 		epicsMutexMustLock(sp->lock);
 		if (status != pvStatOK)
 			errlogSevPrintf(errlogFatal, "seq_disconnect(var '%s', pv '%s'): pvVarDestroy() failure: "
@@ -375,9 +422,8 @@ pvStat seq_camonitor(CHAN *ch, boolean turn_on)
 
 	epicsMutexMustLock(sp->lock);
 	dbch = ch->dbch;
-	assert(dbch);
-	done = turn_on == pvMonIsDefined(dbch->pvid);
-	dbch->gotMonitor = FALSE;
+	/* the channel may have been unassigned meanwhile */
+	done = !dbch || turn_on == (dbch->mon != NULL);
 	epicsMutexUnlock(sp->lock);
 
 	if (done)
@@ -386,17 +432,16 @@ pvStat seq_camonitor(CHAN *ch, boolean turn_on)
 	DEBUG("calling pvVarMonitor%s(%p)\n", turn_on ? "On" : "Off", ch);
 	if (turn_on)
 	{
-		status = pvVarMonitorOn(
-				&dbch->pvid,		/* pvid */
-				ch->type->getType,	/* requested type */
-				ch->count,		/* element count */
-				ch);			/* user arg (channel struct) */
+		status = seqPvMonitorOn(ch);
 	}
 	else
 	{
-		status = pvVarMonitorOff(&dbch->pvid);
+		status = seqPvMonitorOff(ch);
+		/* Reset only here: a repeated call while still subscribed
+		   must not make the next event count a second time */
 		epicsMutexMustLock(sp->lock);
-		sp->gotMonitorCount -= 1;
+		if (status == pvStatOK && seqAtomicCas(&dbch->gotMonitor, 1u, 0u))
+			seqAtomicDec(&sp->gotMonitorCount);
 		epicsMutexUnlock(sp->lock);
 	}
 	if (status != pvStatOK)
@@ -408,15 +453,18 @@ pvStat seq_camonitor(CHAN *ch, boolean turn_on)
 /*
  * seq_conn_handler() - Sequencer connection handler.
  * Called each time a connection is established or broken.
+ * Must not be called with the PV's lock held, see seq_pvreg.c.
  */
 void seq_conn_handler(int connected, void *arg)
 {
 	CHAN	*ch = (CHAN *)arg;
 	PROG	*sp = ch->prog;
-	DBCHAN	*dbch = ch->dbch;
+	DBCHAN	*dbch;
+	boolean	monitor = FALSE;
 
 	epicsMutexMustLock(sp->lock);
 
+	dbch = ch->dbch;
 	if (!dbch)
 	{
 		epicsMutexUnlock(sp->lock);
@@ -431,12 +479,9 @@ void seq_conn_handler(int connected, void *arg)
 			unsigned nss;
 
 			dbch->connected = FALSE;
-			sp->connectCount--;
+			seqAtomicDec(&sp->connectCount);
 
-			if (ch->monitored)
-			{
-				seq_camonitor(ch, FALSE);
-			}
+			monitor = ch->monitored;
 			/* terminate outstanding requests that wait for completion */
 			/* TODO: can there be a race condition with pvPut/pvGet? */
 			for (nss = 0; nss < sp->numSS; nss++)
@@ -445,7 +490,7 @@ void seq_conn_handler(int connected, void *arg)
 
 				ss->getReq[chNum(ch)] = NULL;
 				ss->putReq[chNum(ch)] = NULL;
-				epicsEventSignal(ss->syncSem);
+				ss_signal(ss);
 			}
 		}
 		else
@@ -463,21 +508,17 @@ void seq_conn_handler(int connected, void *arg)
 		{
 			unsigned dbCount;
 			dbch->connected = TRUE;
-			sp->connectCount++;
-			if (sp->gotMonitorCount == sp->monitorCount
-				&& sp->connectCount == sp->assignCount)
-			{
-				epicsEventSignal(sp->ready);
-			}
+			seqAtomicInc(&sp->connectCount);
+			check_ready(sp);
 			assert(pvVarIsDefined(dbch->pvid));
 			dbCount = pvVarGetCount(&dbch->pvid);
 			assert(dbCount >= 0);
 			dbch->dbCount = min(ch->count, (unsigned)dbCount);
 
-			if (ch->monitored)
-			{
-				seq_camonitor(ch, TRUE);
-			}
+			/* A no-op if seqPvCreate already subscribed, but
+			   needed after a disconnect, and when joining a
+			   PV that was already connected */
+			monitor = ch->monitored;
 		}
 		else
 		{
@@ -489,6 +530,12 @@ void seq_conn_handler(int connected, void *arg)
 	}
 	epicsMutexUnlock(sp->lock);
 
+	/* Not under sp->lock, which comes after the PV's lock */
+	if (monitor)
+	{
+		seq_camonitor(ch, connected);
+	}
+
 	/* Wake up each state set that is waiting for event processing.
 	   Why each one? Because pvConnectCount and pvMonitorCount should
 	   act like monitored anonymous channels. Any state set might be
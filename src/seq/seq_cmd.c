@@ -18,6 +18,7 @@ in the file LICENSE that is included with this distribution.
  *    cls.usask.ca
  */
 #include "seq.h"
+#include "seq_debug.h"
 
 struct sequencerProgram {
     seqProgram *prog;
@@ -25,12 +26,18 @@ struct sequencerProgram {
     struct sequencerProgram *next;
 };
 
-/* These are the only global variables in the whole seq library. */
+struct sequencerPvSystem {
+    pvSystem sys;
+    struct sequencerPvSystem *next;
+};
+
+/* These are the only global variables in the whole seq library,
+   apart from the PV registry in seq_pvreg.c. */
 static struct
 {
     epicsMutexId lock;
     struct sequencerProgram *programs;
-    pvSystem pvSys;
+    struct sequencerPvSystem *pvSystems;
 } globals;
 
 static void seqInitPvt(void *arg)
@@ -48,19 +55,40 @@ static void seqLazyInit()
     epicsThreadOnce(&seqOnceFlag, seqInitPvt, NULL);
 }
 
+/* Programs select their pv system with the "pvsys" macro (default CA) */
 void createOrAttachPvSystem(struct program_instance *sp)
 {
+    const char *name = seqMacValGet(sp, "pvsys");
+    struct sequencerPvSystem *ps;
+
+    if (!name || !name[0])
+        name = pvBackendFind(NULL)->name;
     seqLazyInit();
     epicsMutexMustLock(globals.lock);
-    if (!pvSysIsDefined(globals.pvSys)) {
-        pvStat status = pvSysCreate(&globals.pvSys);
-        if (status != pvStatOK) {
-            errlogPrintf("getPvSystem: pvSysCreate() failure\n");
+    foreach(ps, globals.pvSystems) {
+        if (strcmp(pvSysGetName(ps->sys), name) == 0) {
+            break;
+        }
+    }
+    if (!ps) {
+        ps = (struct sequencerPvSystem *)malloc(sizeof *ps);
+        if (!ps) {
+            errlogSevPrintf(errlogFatal, "createOrAttachPvSystem: out of memory");
+            sp->pvSys = nullPvSys;
+        } else if (pvSysCreateByName(&ps->sys, name) != pvStatOK) {
+            errlogPrintf("createOrAttachPvSystem: pvSysCreate(%s) failure: %s\n",
+                name, pvSysGetMess(ps->sys));
+            free(ps);
+            sp->pvSys = nullPvSys;
+        } else {
+            ps->next = globals.pvSystems;
+            globals.pvSystems = ps;
+            sp->pvSys = ps->sys;
         }
     } else {
-        pvSysAttach(globals.pvSys);
+        pvSysAttach(ps->sys);
+        sp->pvSys = ps->sys;
     }
-    sp->pvSys = globals.pvSys;
     epicsMutexUnlock(globals.lock);
 }
 
@@ -151,10 +151,19 @@ static pvStat wait_complete(
 	const char *call = evtype == pvEventGet ? "pvGet" : "pvPut";
 	while (*req)
 	{
+		/* other events wake us up, too (with +T, also those of
+		   other state sets), so keep track of the remaining time */
+		double before, after;
+
+		pvTimeGetCurrentDouble(&before);
 		switch (epicsEventWaitWithTimeout(ss->syncSem, tmo))
 		{
 		case epicsEventWaitOK:
-			break;
+			pvTimeGetCurrentDouble(&after);
+			tmo -= (after - before);
+			if (tmo > 0.0 || !*req)
+				break;
+			/* else: fall through to timeout */
 		case epicsEventWaitTimeout:
 			*req = NULL;			/* cancel the request */
 			completion_timeout(evtype, meta);
@@ -179,9 +188,11 @@ epicsShareFunc pvStat seq_pvGet(SS_ID ss, CH_ID chId, enum compType compType)
 }
 
 /*
- * Get value from a channel, with timeout.
+ * Issue a get request (helper for seq_pvGetTmo and seq_pvArrayGet).
+ * Anonymous channels in safe mode complete immediately, otherwise
+ * success means that a request is now pending.
  */
-epicsShareFunc pvStat seq_pvGetTmo(SS_ID ss, CH_ID chId, enum compType compType, double tmo)
+static pvStat get_request(SS_ID ss, CH_ID chId, enum compType compType, double tmo)
 {
 	PROG		*sp = ss->prog;
 	CHAN		*ch = sp->chan + chId;
@@ -209,16 +220,14 @@ epicsShareFunc pvStat seq_pvGetTmo(SS_ID ss, CH_ID chId, enum compType compType,
 		return pvStatERROR;
 	}
 
-	if (compType == DEFAULT)
-	{
-		compType = optTest(sp, OPT_ASYNC) ? ASYNC : SYNC;
-	}
-
 	status = check_pending(pvEventGet, ss, ss->getReq + chId, ch->varName,
 		dbch, meta, compType, tmo);
 	if (status != pvStatOK)
 		return status;
 
+	if (optTest(sp, OPT_SAFE))
+		bitClearAtomic(ss->getDone, chId);
+
 	/* Allocate and initialize a pv request */
 	req = (PVREQ *)freeListMalloc(sp->pvReqPool);
 	req->ss = ss;
@@ -245,25 +254,128 @@ epicsShareFunc pvStat seq_pvGetTmo(SS_ID ss, CH_ID chId, enum compType compType,
 		check_connected(dbch, meta);
 		return status;
 	}
+	return pvStatOK;
+}
+
+/*
+ * Wait for a get request issued with compType SYNC. In safe mode,
+ * copy the value to the state set local buffer.
+ */
+static pvStat get_wait(SS_ID ss, CH_ID chId, double tmo)
+{
+	PROG		*sp = ss->prog;
+	CHAN		*ch = sp->chan + chId;
+	pvStat		status;
+
+	if (!ch->dbch)
+		return pvStatOK;
+	status = wait_complete(pvEventGet, ss, ss->getReq + chId, ch->dbch,
+		metaPtr(ch,ss), tmo);
+	if (status != pvStatOK)
+		return status;
+	if (optTest(sp, OPT_SAFE))
+	{
+		bitClearAtomic(ss->getDone, chId);
+		/* Copy regardless of whether dirty flag is set or not */
+		ss_read_buffer(ss, ch, FALSE);
+	}
+	return pvStatOK;
+}
+
+/*
+ * Get value from a channel, with timeout.
+ */
+epicsShareFunc pvStat seq_pvGetTmo(SS_ID ss, CH_ID chId, enum compType compType, double tmo)
+{
+	PROG		*sp = ss->prog;
+	pvStat		status;
+
+	if (compType == DEFAULT)
+	{
+		compType = optTest(sp, OPT_ASYNC) ? ASYNC : SYNC;
+	}
+
+	status = get_request(ss, chId, compType, tmo);
+	if (status != pvStatOK)
+		return status;
 
 	/* Synchronous: wait for completion */
-	if (compType == SYNC)
+	if (compType == SYNC && sp->chan[chId].dbch)
 	{
 		pvSysFlush(sp->pvSys);
-		status = wait_complete(pvEventGet, ss, ss->getReq + chId, dbch, meta, tmo);
+		return get_wait(ss, chId, tmo);
+	}
+	return pvStatOK;
+}
+
+/*
+ * Array variant of seq_pvGetTmo. All requests are issued before
+ * the (single) flush, and the timeout applies to the whole batch.
+ * Stops issuing requests at the first failure.
+ */
+epicsShareFunc pvStat seq_pvArrayGet(
+	SS_ID		ss,
+	CH_ID		chId,
+	unsigned	length,
+	enum compType	compType,
+	double		tmo)
+{
+	PROG		*sp = ss->prog;
+	pvStat		status = pvStatOK;
+	unsigned	n, issued;
+	double		deadline, now;
+
+	if (compType == DEFAULT)
+	{
+		compType = optTest(sp, OPT_ASYNC) ? ASYNC : SYNC;
+	}
+
+	pvTimeGetCurrentDouble(&now);
+	deadline = now + tmo;
+	for (issued = 0; issued < length; issued++)
+	{
+		CH_ID	c = chId + issued;
+		boolean	busy = ss->getReq[c] != NULL;
+
+		if (compType == SYNC && issued > 0 && now >= deadline)
+		{
+			completion_timeout(pvEventGet, metaPtr(sp->chan + c, ss));
+			status = pvStatTIMEOUT;
+			break;
+		}
+		status = get_request(ss, c, compType, deadline - now);
 		if (status != pvStatOK)
-			return status;
-		if (optTest(sp, OPT_SAFE))
-			/* Copy regardless of whether dirty flag is set or not */
-			ss_read_buffer(ss, ch, FALSE);
+			break;
+		if (busy)
+			/* may have waited for a pending request */
+			pvTimeGetCurrentDouble(&now);
 	}
 
-	return pvStatOK;
+	if (compType == SYNC)
+	{
+		pvSysFlush(sp->pvSys);
+		for (n = 0; n < issued; n++)
+		{
+			pvStat wstatus;
+
+			pvTimeGetCurrentDouble(&now);
+			wstatus = get_wait(ss, chId + n, deadline > now ? deadline - now : 0.0);
+			if (status == pvStatOK)
+				status = wstatus;
+		}
+	}
+
+	DEBUG("pvArrayGet: chId=%u, length=%u, issued=%u, status=%d\n",
+		chId, length, issued, status);
+
+	return status;
 }
 
 /*
  * Return whether the last get completed. In safe mode, as a
- * side effect, copy value from shared buffer to state set local buffer.
+ * side effect, copy value from shared buffer to state set local buffer,
+ * but only once per completed request: conditions that poll this
+ * function must not copy large arrays again on every evaluation.
  */
 epicsShareFunc boolean seq_pvGetComplete(
 	SS_ID	ss,
@@ -284,7 +396,8 @@ epicsShareFunc boolean seq_pvGetComplete(
 	else if (!ss->getReq[chId])
 	{
 		pvStat status = check_connected(ch->dbch, metaPtr(ch,ss));
-		if (status == pvStatOK && optTest(sp, OPT_SAFE))
+		if (status == pvStatOK && optTest(sp, OPT_SAFE)
+			&& (bitClearAtomic(ss->getDone, chId) & (1u<<(chId%NBITS))))
 		{
 			/* In safe mode, copy value and meta data from shared buffer
 			   to ss local buffer. */
@@ -385,9 +498,52 @@ static void *putq_cp(void *dest, const void *src, size_t elemSize)
 		arg->var, ch->type->size * ch->count);
 }
 
-static void anonymous_put(SS_ID ss, CHAN *ch)
+/*
+ * Wait until a queue has space, the timeout expires, or the program
+ * is stopped. Readers of queues with policy block wake us up, see
+ * wake_queue_writers.
+ */
+static void wait_queue_space(SS_ID ss, QUEUE queue, double tmo)
+{
+	PROG	*sp = ss->prog;
+	double	before, after;
+
+	/* Announce ourselves before looking, so that a reader that
+	   makes space after we looked sees us */
+	seqAtomicInc(&sp->queueWriters);
+	while (seqQueueIsFull(queue) && tmo > 0.0 && !sp->die)
+	{
+		pvTimeGetCurrentDouble(&before);
+		epicsEventWaitWithTimeout(ss->syncSem, tmo);
+		pvTimeGetCurrentDouble(&after);
+		tmo -= (after - before);
+	}
+	seqAtomicDec(&sp->queueWriters);
+}
+
+/*
+ * Wake up state sets that may be waiting in wait_queue_space, after
+ * taking elements from the queue of channel ch.
+ */
+static void wake_queue_writers(PROG *sp, CHAN *ch)
+{
+	unsigned nss;
+
+	if (ch->queuePolicy != SYNCQ_BLOCK)
+		return;
+	seqAtomicBarrier();
+	if (!sp->queueWriters)
+		return;
+	/* we do not know which one waits, but spurious wakeups
+	   are harmless */
+	for (nss = 0; nss < sp->numSS; nss++)
+		epicsEventSignal(sp->ss[nss].syncSem);
+}
+
+static pvStat anonymous_put(SS_ID ss, CHAN *ch, double tmo)
 {
 	char *var = valPtr(ch,ss);
+	pvStat status = pvStatOK;
 
 	if (ch->queue)
 	{
@@ -401,22 +557,27 @@ static void anonymous_put(SS_ID ss, CHAN *ch)
 			type, size, ch->count, pv_size_n(type, ch->count), queue);
 		print_channel_value(DEBUG, ch, var);
 
-		/* Note: Must lock here because multiple state sets can issue
-		   pvPut calls concurrently. OTOH, no need to lock against CA
-		   callbacks, because anonymous and named PVs are disjoint. */
-		epicsMutexMustLock(ch->varLock);
-
+		if (ch->queuePolicy == SYNCQ_BLOCK)
+			wait_queue_space(ss, queue, tmo);
+		/* Note: multiple state sets can issue pvPut calls
+		   concurrently, but the queue handles multiple writers. */
 		full = seqQueuePutF(queue, putq_cp, &arg);
-		if (full)
+		if (full && ch->queuePolicy == SYNCQ_BLOCK)
+		{
+			status = pvStatTIMEOUT;
+		}
+		/* Report only the first loss, seqQueueShow has the counters */
+		else if (full && seqQueueNumDropped(queue) == 1)
 		{
 			errlogSevPrintf(errlogMinor,
 			  "pvPut on queued channel '%s' (anonymous): "
-			  "last queue element overwritten (queue is full)\n",
+			  "queue is full, further losses are not reported\n",
 			  ch->varName
 			);
 		}
-
-		epicsMutexUnlock(ch->varLock);
+		/* A queue below its wakeup watermark wakes up nobody (yet) */
+		if (ss_queue_defer(ch))
+			return status;
 	}
 	else
 	{
@@ -428,6 +589,7 @@ static void anonymous_put(SS_ID ss, CHAN *ch)
 		seq_efSet(ss, ch->syncedTo);
 	/* Wake up each state set that uses this channel in an event */
 	ss_wakeup(ss->prog, ch->eventNum);
+	return status;
 }
 
 /*
@@ -439,9 +601,10 @@ epicsShareFunc pvStat seq_pvPut(SS_ID ss, CH_ID chId, enum compType compType)
 }
 
 /*
- * Put a variable's value to a PV, with timeout.
+ * Issue a put request (helper for seq_pvPutTmo and seq_pvArrayPut).
+ * A request is left pending only if compType is SYNC or ASYNC.
  */
-epicsShareFunc pvStat seq_pvPutTmo(SS_ID ss, CH_ID chId, enum compType compType, double tmo)
+static pvStat put_request(SS_ID ss, CH_ID chId, enum compType compType, double tmo)
 {
 	PROG	*sp = ss->prog;
 	CHAN	*ch = sp->chan + chId;
@@ -457,8 +620,7 @@ epicsShareFunc pvStat seq_pvPutTmo(SS_ID ss, CH_ID chId, enum compType compType,
 	/* First handle anonymous PV (safe mode only) */
 	if (optTest(sp, OPT_SAFE) && !dbch)
 	{
-		anonymous_put(ss, ch);
-		return pvStatOK;
+		return anonymous_put(ss, ch, tmo);
 	}
 	if (!dbch)
 	{
@@ -528,16 +690,92 @@ epicsShareFunc pvStat seq_pvPutTmo(SS_ID ss, CH_ID chId, enum compType compType,
 			check_connected(dbch, meta);
 			return status;
 		}
+	}
+	return pvStatOK;
+}
 
-		if (compType == SYNC)			/* wait for completion */
+/*
+ * Put a variable's value to a PV, with timeout.
+ */
+epicsShareFunc pvStat seq_pvPutTmo(SS_ID ss, CH_ID chId, enum compType compType, double tmo)
+{
+	PROG	*sp = ss->prog;
+	DBCHAN	*dbch = sp->chan[chId].dbch;
+	pvStat	status;
+
+	status = put_request(ss, chId, compType, tmo);
+	if (status != pvStatOK)
+		return status;
+
+	if (compType == SYNC && dbch)		/* wait for completion */
+	{
+		pvSysFlush(sp->pvSys);
+		return wait_complete(pvEventPut, ss, ss->putReq + chId, dbch,
+			metaPtr(sp->chan + chId, ss), tmo);
+	}
+	return pvStatOK;
+}
+
+/*
+ * Array variant of seq_pvPutTmo. All requests are issued before
+ * the (single) flush, and the timeout applies to the whole batch.
+ * Stops issuing requests at the first failure.
+ */
+epicsShareFunc pvStat seq_pvArrayPut(
+	SS_ID		ss,
+	CH_ID		chId,
+	unsigned	length,
+	enum compType	compType,
+	double		tmo)
+{
+	PROG		*sp = ss->prog;
+	pvStat		status = pvStatOK;
+	unsigned	n, issued;
+	double		deadline, now;
+
+	pvTimeGetCurrentDouble(&now);
+	deadline = now + tmo;
+	for (issued = 0; issued < length; issued++)
+	{
+		CH_ID	c = chId + issued;
+		boolean	busy = ss->putReq[c] != NULL;
+
+		if (compType == SYNC && issued > 0 && now >= deadline)
+		{
+			completion_timeout(pvEventPut, metaPtr(sp->chan + c, ss));
+			status = pvStatTIMEOUT;
+			break;
+		}
+		status = put_request(ss, c, compType, deadline - now);
+		if (status != pvStatOK)
+			break;
+		if (busy)
+			/* may have waited for a pending request */
+			pvTimeGetCurrentDouble(&now);
+	}
+
+	if (compType == SYNC)
+	{
+		pvSysFlush(sp->pvSys);
+		for (n = 0; n < issued; n++)
 		{
-			pvSysFlush(sp->pvSys);
-			status = wait_complete(pvEventPut, ss, ss->putReq + chId, dbch, meta, tmo);
-			if (status != pvStatOK)
-				return status;
+			CHAN	*ch = sp->chan + chId + n;
+			pvStat	wstatus;
+
+			if (!ch->dbch)
+				continue;
+			pvTimeGetCurrentDouble(&now);
+			wstatus = wait_complete(pvEventPut, ss, ss->putReq + chId + n,
+				ch->dbch, metaPtr(ch,ss), deadline > now ? deadline - now : 0.0);
+			if (status == pvStatOK)
+				status = wstatus;
 		}
 	}
-	return pvStatOK;
+
+	DEBUG("pvArrayPut: chId=%u, length=%u, issued=%u, status=%d\n",
+		chId, length, issued, status);
+
+	return status;
 }
 
 /*
@@ -695,26 +933,30 @@ epicsShareFunc pvStat seq_pvAssign(SS_ID ss, CH_ID chId, const char *pvName)
 
 		epicsMutexUnlock(sp->lock);
 
-		status = pvVarDestroy(&dbch->pvid);
+		status = seqPvDestroy(ch, dbch);
 
 		epicsMutexMustLock(sp->lock);
 
-		sp->assignCount--;
+		seqAtomicDec(&sp->assignCount);
 
 		if (dbch->connected)	/* see connection handler */
 		{
 			dbch->connected = FALSE;
-			sp->connectCount--;
+			seqAtomicDec(&sp->connectCount);
 
 			/* Must not call seq_camonitor(ch, FALSE), it would give an
-			error because channel is already dead. pvVarDestroy takes
-                        care that the monid inside the pvid gets invalidated. */
+			error because channel is already dead. seqPvDestroy takes
+                        care that the channel's monitor gets removed. */
 
 			/* Note ch->monitored remains on because it is a configuration
 			value that belongs to the variable and newly created channels
 			for the same variable should inherit this configuration. */
 		}
 
+		/* The new PV must deliver its own first monitor */
+		if (seqAtomicCas(&dbch->gotMonitor, 1u, 0u))
+			seqAtomicDec(&sp->gotMonitorCount);
+
 		if (status != pvStatOK)
 		{
 			errlogSevPrintf(errlogFatal, "pvAssign(var %s, pv %s): pvVarDestroy() failure: "
@@ -753,24 +995,23 @@ epicsShareFunc pvStat seq_pvAssign(SS_ID ss, CH_ID chId, const char *pvName)
 		}
 		ch->dbch = dbch;
 
-		status = pvVarCreate(
-			sp->pvSys,		/* PV system context */
-			dbch->dbName,		/* DB channel name */
-			seq_conn_handler,	/* connection handler routine */
-			seq_event_handler,	/* event handler routine */
-			ch,			/* user ptr is CHAN structure */
-			&dbch->pvid);		/* ptr to pvid */
+		/* If the PV is shared and already connected, seqPvCreate
+		   calls the connection handler, so we must count the
+		   assignment first and must not hold the lock. */
+		seqAtomicInc(&sp->assignCount);
+		epicsMutexUnlock(sp->lock);
+
+		status = seqPvCreate(ch);
+
+		epicsMutexMustLock(sp->lock);
 		if (status != pvStatOK)
 		{
 			errlogSevPrintf(errlogFatal, "pvAssign(var %s, pv %s): pvVarCreate() failure: "
 				"%s\n", ch->varName, dbch->dbName, pvVarGetMess(dbch->pvid));
+			seqAtomicDec(&sp->assignCount);
 			free(ch->dbch->dbName);
 			free(ch->dbch);
 		}
-		else
-		{
-			sp->assignCount++;
-		}
 	}
 
 	epicsMutexUnlock(sp->lock);
@@ -885,35 +1126,13 @@ epicsShareFunc void seq_pvArraySync(SS_ID ss, CH_ID chId, unsigned length, EF_ID
 
 		if (old_ev_flag != new_ev_flag)
 		{
+			/* Readers of the synced masks do not lock, so we
+			   must modify them atomically */
 			if (old_ev_flag)
-			{
-				/* remove it from the old list */
-				CHAN *ch = sp->syncedChans[old_ev_flag];
-				assert(ch);			/* since old_ev_flag != 0 */
-				if (ch == this_ch)		/* first in list */
-				{
-					sp->syncedChans[old_ev_flag] = this_ch->nextSynced;
-					ch->nextSynced = 0;
-				}
-				else
-				{
-					while (ch->nextSynced != this_ch)
-					{
-						ch = ch->nextSynced;
-						assert(ch);	/* since old_ev_flag != 0 */
-					}
-					assert (ch->nextSynced == this_ch);
-					ch->nextSynced = this_ch->nextSynced;
-				}
-			}
+				bitClearAtomic(syncedMask(sp, old_ev_flag), chNum(this_ch));
 			this_ch->syncedTo = new_ev_flag;
 			if (new_ev_flag)
-			{
-				/* insert it into the new list */
-				CHAN *ch = sp->syncedChans[new_ev_flag];
-				sp->syncedChans[new_ev_flag] = this_ch;
-				this_ch->nextSynced = ch;
-			}
+				bitSetAtomic(syncedMask(sp, new_ev_flag), chNum(this_ch));
 		}
 	}
 	epicsMutexUnlock(sp->lock);
@@ -1063,15 +1282,11 @@ epicsShareFunc void seq_efSet(SS_ID ss, EF_ID ev_flag)
 	DEBUG("efSet: sp=%p, ev_flag=%d\n", sp, ev_flag);
 	assert(ev_flag > 0 && ev_flag <= sp->numEvFlags);
 
-	epicsMutexMustLock(sp->lock);
-
 	/* Set this bit */
-	bitSet(sp->evFlags, ev_flag);
+	bitSetAtomic(sp->evFlags, ev_flag);
 
 	/* Wake up state sets that are waiting for this event flag */
 	ss_wakeup(sp, ev_flag);
-
-	epicsMutexUnlock(sp->lock);
 }
 
 /*
@@ -1081,16 +1296,16 @@ epicsShareFunc void seq_efInit(PROG_ID sp, EF_ID ev_flag, unsigned val)
 {
 	assert(ev_flag > 0 && ev_flag <= sp->numEvFlags);
 
-	epicsMutexMustLock(sp->lock);
 	if (val)
-		bitSet(sp->evFlags, ev_flag);
+		bitSetAtomic(sp->evFlags, ev_flag);
 	else
-		bitClear(sp->evFlags, ev_flag);
-	epicsMutexUnlock(sp->lock);
+		bitClearAtomic(sp->evFlags, ev_flag);
 }
 
 /*
  * Return whether event flag is set.
+ * No locking needed: in safe mode we may copy values of synced
+ * channels that are newer than the flag, but never older.
  */
 epicsShareFunc boolean seq_efTest(SS_ID ss, EF_ID ev_flag)
 /* event flag */
@@ -1099,17 +1314,15 @@ epicsShareFunc boolean seq_efTest(SS_ID ss, EF_ID ev_flag)
 	boolean	isSet;
 
 	assert(ev_flag > 0 && ev_flag <= ss->prog->numEvFlags);
-	epicsMutexMustLock(sp->lock);
 
 	isSet = bitTest(sp->evFlags, ev_flag);
+	seqAtomicBarrier();
 
 	DEBUG("efTest: ev_flag=%d, isSet=%d\n", ev_flag, isSet);
 
 	if (optTest(sp, OPT_SAFE))
 		ss_read_buffer_selective(sp, ss, ev_flag);
 
-	epicsMutexUnlock(sp->lock);
-
 	return isSet;
 }
 
@@ -1122,41 +1335,44 @@ epicsShareFunc boolean seq_efClear(SS_ID ss, EF_ID ev_flag)
 	boolean	isSet;
 
 	assert(ev_flag > 0 && ev_flag <= ss->prog->numEvFlags);
-	epicsMutexMustLock(sp->lock);
 
-	isSet = bitTest(sp->evFlags, ev_flag);
-	bitClear(sp->evFlags, ev_flag);
+	isSet = (bitClearAtomic(sp->evFlags, ev_flag)
+		& (1u<<(ev_flag%NBITS))) != 0;
 
 	/* Wake up state sets that are waiting for this event flag */
 	ss_wakeup(sp, ev_flag);
 
-	epicsMutexUnlock(sp->lock);
-
 	return isSet;
 }
 
 /*
  * Atomically test event flag against outstanding events, then clear it
  * and return whether it was set.
+ * In safe mode we must lock: proc_db_events writes a synced channel and
+ * sets the flag while holding sp->lock, and we must not clear a flag
+ * that belongs to a value we do not copy.
  */
 epicsShareFunc boolean seq_efTestAndClear(SS_ID ss, EF_ID ev_flag)
 {
 	PROG	*sp = ss->prog;
 	boolean	isSet;
+	boolean	safe = optTest(sp, OPT_SAFE);
 
 	assert(ev_flag > 0 && ev_flag <= ss->prog->numEvFlags);
-	epicsMutexMustLock(sp->lock);
+	if (safe)
+		epicsMutexMustLock(sp->lock);
 
-	isSet = bitTest(sp->evFlags, ev_flag);
-	bitClear(sp->evFlags, ev_flag);
+	isSet = (bitClearAtomic(sp->evFlags, ev_flag)
+		& (1u<<(ev_flag%NBITS))) != 0;
 
 	DEBUG("efTestAndClear: ev_flag=%d, isSet=%d, ss=%d\n", ev_flag, isSet,
 		(int)ssNum(ss));
 
-	if (optTest(sp, OPT_SAFE))
+	if (safe)
+	{
 		ss_read_buffer_selective(sp, ss, ev_flag);
-
-	epicsMutexUnlock(sp->lock);
+		epicsMutexUnlock(sp->lock);
+	}
 
 	return isSet;
 }
@@ -1167,12 +1383,12 @@ struct getq_cp_arg {
 	PVMETA	*meta;
 };
 
-static void *getq_cp(void *dest, const void *value, size_t elemSize)
+static void *getq_cp(void *dest, const void *value, size_t size)
 {
 	struct getq_cp_arg *arg = (struct getq_cp_arg *)dest;
 	CHAN	*ch = arg->ch;
 	PVMETA	*meta = arg->meta;
-	void	*var = arg->var;
+	char	*var = (char *)arg->var;
 	pvType	type = ch->type->getType;
 	size_t	count = ch->count;
 
@@ -1185,6 +1401,18 @@ static void *getq_cp(void *dest, const void *value, size_t elemSize)
 		meta->timeStamp = pv_stamp(value,type);
 		count = ch->dbch->dbCount;
 	}
+	if (ch->queueBytes)
+	{
+		/* number of elements actually stored (see pv_size_n);
+		   clear the rest */
+		size_t stored = 1 + (size - pv_size(type)) / ch->type->size;
+
+		if (stored < count)
+		{
+			memset(var + ch->type->size * stored, 0, ch->type->size * (count - stored));
+			count = stored;
+		}
+	}
 	return memcpy(var, pv_value_ptr(value,type), ch->type->size * count);
 }
 
@@ -1211,21 +1439,77 @@ epicsShareFunc boolean seq_pvGetQ(SS_ID ss, CH_ID chId)
 	}
 
 	was_empty = seqQueueGetF(ch->queue, getq_cp, &arg);
+	if (!was_empty)
+		wake_queue_writers(sp, ch);
 
-	if (ev_flag)
+	/* If queue is now empty, clear the event flag */
+	if (ev_flag && seqQueueIsEmpty(ch->queue))
 	{
-		epicsMutexMustLock(sp->lock);
-		/* If queue is now empty, clear the event flag */
-		if (seqQueueIsEmpty(ch->queue))
-		{
-			bitClear(sp->evFlags, ev_flag);
-		}
-		epicsMutexUnlock(sp->lock);
+		bitClearAtomic(sp->evFlags, ev_flag);
+		/* A put may have set the flag just before we cleared it */
+		if (!seqQueueIsEmpty(ch->queue))
+			seq_efSet(ss, ev_flag);
 	}
 
 	return (!was_empty);
 }
 
+struct getq_many_arg {
+	struct getq_cp_arg cp;
+	size_t	size;
+};
+
+static void *getq_many_cp(void *dest, const void *value, size_t elemSize)
+{
+	struct getq_many_arg *arg = (struct getq_many_arg *)dest;
+	void	*var = arg->cp.var;
+
+	getq_cp(&arg->cp, value, elemSize);
+	arg->cp.var = (char *)var + arg->size;
+	return var;
+}
+
+/*
+ * Get up to maxNum values from a queued PV into the array dest.
+ */
+epicsShareFunc unsigned seq_pvGetQMany(SS_ID ss, CH_ID chId, void *dest, unsigned maxNum)
+{
+	PROG	*sp = ss->prog;
+	CHAN	*ch = sp->chan + chId;
+	EF_ID	ev_flag = ch->syncedTo;
+	size_t	num;
+	struct getq_many_arg arg;
+
+	if (!ch->queue)
+	{
+		errlogSevPrintf(errlogMajor,
+			"pvGetQMany(%s): user error (not queued)\n",
+			ch->varName
+		);
+		return 0;
+	}
+
+	arg.cp.ch = ch;
+	arg.cp.var = dest;
+	arg.cp.meta = metaPtr(ch,ss);
+	arg.size = ch->type->size * ch->count;
+
+	num = seqQueueGetMany(ch->queue, getq_many_cp, &arg, maxNum);
+	if (num > 0)
+		wake_queue_writers(sp, ch);
+
+	/* If queue is now empty, clear the event flag */
+	if (ev_flag && seqQueueIsEmpty(ch->queue))
+	{
+		bitClearAtomic(sp->evFlags, ev_flag);
+		/* A put may have set the flag just before we cleared it */
+		if (!seqQueueIsEmpty(ch->queue))
+			seq_efSet(ss, ev_flag);
+	}
+
+	return (unsigned)num;
+}
+
 /*
  * Flush elements on syncQ queue and clear event flag.
  */
@@ -1248,13 +1532,15 @@ epicsShareFunc void seq_pvFlushQ(SS_ID ss, CH_ID chId)
 		seqQueueUsed(ch->queue));
 
 	seqQueueFlush(ch->queue);
+	wake_queue_writers(sp, ch);
 
 	if (ev_flag)
 	{
-		epicsMutexMustLock(sp->lock);
 		/* Clear event flag */
-		bitClear(sp->evFlags, ev_flag);
-		epicsMutexUnlock(sp->lock);
+		bitClearAtomic(sp->evFlags, ev_flag);
+		/* A put may have set the flag just before we cleared it */
+		if (!seqQueueIsEmpty(ch->queue))
+			seq_efSet(ss, ev_flag);
 	}
 }
 
@@ -1262,14 +1548,18 @@ epicsShareFunc void seq_pvFlushQ(SS_ID ss, CH_ID chId)
  * Test whether a given delay has expired.
  *
  * As a side-effect, adjust the state set's wakeupTime if our delay
- * is shorter than previously tested ones.
+ * is shorter than previously tested ones. The clock is read only once
+ * per evaluation of the when() conditions, so that all delays are
+ * checked against the same point in time.
  */
 epicsShareFunc boolean seq_delay(SS_ID ss, double delay)
 {
 	boolean	expired;
 	double	now, timeExpired;
 
-	pvTimeGetCurrentDouble(&now);
+	if (ss->evalTime == 0.0)
+		pvTimeGetCurrentDouble(&ss->evalTime);
+	now = ss->evalTime;
 	timeExpired = ss->timeEntered + delay;
 	expired = timeExpired <= now;
 	if (!expired && timeExpired < ss->wakeupTime)
@@ -1293,11 +1583,14 @@ epicsShareFunc boolean seq_optGet(SS_ID ss, const char *opt)
 	switch (opt[0])
 	{
 	case 'a': return optTest(sp, OPT_ASYNC);
+	case 'b': return optTest(sp, OPT_BATCH);
 	case 'c': return optTest(sp, OPT_CONN);
 	case 'd': return optTest(sp, OPT_DEBUG);
 	case 'e': return optTest(sp, OPT_NEWEF);
 	case 'r': return optTest(sp, OPT_REENT);
 	case 's': return optTest(sp, OPT_SAFE);
+	case 'L': return optTest(sp, OPT_LOCKFREE);
+	case 'T': return optTest(sp, OPT_COOP);
 	default:  return FALSE;
 	}
 }
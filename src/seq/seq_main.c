@@ -12,7 +12,7 @@ in the file LICENSE that is included with this distribution.
 #include "seq_debug.h"
 
 static boolean init_sprog(PROG *sp, seqProgram *seqProg);
-static boolean init_sscb(PROG *sp, SSCB *ss, seqSS *seqSS);
+static boolean init_sscb(PROG *sp, SSCB *ss, seqSS *seqSS, seqChan *seqChan);
 static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan);
 
 /*
@@ -129,6 +129,19 @@ epicsShareFunc epicsThreadId epicsShareAPI seq(
 	if (sp->threadPriority > THREAD_PRIORITY)
 		sp->threadPriority = THREAD_PRIORITY;
 
+	/* Run state sets in the worker pool? */
+	str = seqMacValGet(sp, "pool");
+	if (str && str[0] != '\0' && strcmp(str, "0") != 0)
+	{
+		if (optTest(sp, OPT_COOP))
+			errlogSevPrintf(errlogMinor,
+				"seq: warning: program %s was compiled with option +T, "
+				"ignoring parameter pool=%s\n",
+				sp->progName, str);
+		else
+			sp->pooled = TRUE;
+	}
+
 	tid = epicsThreadCreate(threadName, sp->threadPriority,
 		sp->stackSize, sequencer, sp);
 	if (!tid)
@@ -198,6 +211,13 @@ static boolean init_sprog(PROG *sp, seqProgram *seqProg)
 		errlogSevPrintf(errlogFatal, "init_sprog: epicsEventCreate failed\n");
 		return FALSE;
 	}
+	/* Timer queue for delays is shared by all programs in the process */
+	sp->timerQueue = epicsTimerQueueAllocate(TRUE, THREAD_PRIORITY);
+	if (!sp->timerQueue)
+	{
+		errlogSevPrintf(errlogFatal, "init_sprog: epicsTimerQueueAllocate failed\n");
+		return FALSE;
+	}
 
 	/* Allocate an array for event flag bits. Note this does
 	   *not* reserve space for all event numbers (i.e. including
@@ -210,7 +230,16 @@ static boolean init_sprog(PROG *sp, seqProgram *seqProg)
 		return FALSE;
 	}
 	/* NOTE: event flags count from 1 upward */
-	sp->syncedChans = newArray(CHAN*, sp->numEvFlags+1);
+	if (sp->numChans > 0)
+	{
+		sp->syncedChans = newArray(bitMask,
+			(sp->numEvFlags+1) * NWORDS(sp->numChans));
+		if (!sp->syncedChans)
+		{
+			errlogSevPrintf(errlogFatal, "init_sprog: calloc failed\n");
+			return FALSE;
+		}
+	}
 
 	/* Allocate and initialize syncQ queues */
 	if (sp->numQueues > 0)
@@ -242,7 +271,7 @@ static boolean init_sprog(PROG *sp, seqProgram *seqProg)
 	}
 	for (nss = 0; nss < sp->numSS; nss++)
 	{
-		if (!init_sscb(sp, sp->ss + nss, seqProg->ss + nss))
+		if (!init_sscb(sp, sp->ss + nss, seqProg->ss + nss, seqProg->chan))
 			return FALSE;
 	}
 
@@ -267,7 +296,7 @@ static boolean init_sprog(PROG *sp, seqProgram *seqProg)
 /*
  * Initialize a state set control block
  */
-static boolean init_sscb(PROG *sp, SSCB *ss, seqSS *seqSS)
+static boolean init_sscb(PROG *sp, SSCB *ss, seqSS *seqSS, seqChan *seqChan)
 {
 	/* Fill in SSCB */
 	ss->ssName = seqSS->ssName;
@@ -279,14 +308,35 @@ static boolean init_sscb(PROG *sp, SSCB *ss, seqSS *seqSS)
 	ss->threadId = 0;
 	ss->timeEntered = epicsINF;
 	ss->wakeupTime = epicsINF;
+	ss->timerTime = epicsINF;
 	ss->prog = sp;
 
-	ss->syncSem = epicsEventCreate(epicsEventEmpty);
+	ss->wakeupTimer = epicsTimerQueueCreateTimer(sp->timerQueue,
+		ss_timer_expired, ss);
+	if (!ss->wakeupTimer)
+	{
+		errlogSevPrintf(errlogFatal, "init_sscb: epicsTimerQueueCreateTimer failed\n");
+		return FALSE;
+	}
+
+	/* With option +T all state sets wait on the first one's semaphore */
+	if (optTest(sp, OPT_COOP) && ss != sp->ss)
+		ss->syncSem = sp->ss->syncSem;
+	else
+		ss->syncSem = epicsEventCreate(epicsEventEmpty);
 	if (!ss->syncSem)
 	{
 		errlogSevPrintf(errlogFatal, "init_sscb: epicsEventCreate failed\n");
 		return FALSE;
 	}
+	/* Pending events use the same numbering as event masks */
+	ss->pending = newArray(bitMask, NWORDS(sp->numEvFlags + sp->numChans));
+	ss->changed = newArray(bitMask, NWORDS(sp->numEvFlags + sp->numChans));
+	if (!ss->pending || !ss->changed)
+	{
+		errlogSevPrintf(errlogFatal, "init_sscb: calloc failed\n");
+		return FALSE;
+	}
 
 	if (sp->numChans > 0)
 	{
@@ -329,16 +379,53 @@ static boolean init_sscb(PROG *sp, SSCB *ss, seqSS *seqSS)
 	{
 		if (sp->numChans > 0)
 		{
-			ss->dirty = newArray(boolean, sp->numChans);
-			if (!ss->dirty)
+			ss->dirty = newArray(bitMask, NWORDS(sp->numChans));
+			ss->getDone = newArray(bitMask, NWORDS(sp->numChans));
+			if (!ss->dirty || !ss->getDone)
 			{
 				errlogSevPrintf(errlogFatal, "init_sscb: calloc failed\n");
 				return FALSE;
 			}
 		}
-		if (sp->varSize > 0)
+		ss->varSize = sp->varSize;
+		/* Local copy may hold only the variables the state set uses */
+		if (seqSS->varSize > 0)
+		{
+			unsigned nch, nf;
+
+			ss->varSubset = TRUE;
+			ss->varFields = seqSS->varFields;
+			ss->numVarFields = seqSS->numVarFields;
+			ss->varSize = seqSS->varSize;
+			if (sp->numChans > 0)
+			{
+				ss->chanOffset = newArray(size_t, sp->numChans);
+				if (!ss->chanOffset)
+				{
+					errlogSevPrintf(errlogFatal, "init_sscb: calloc failed\n");
+					return FALSE;
+				}
+			}
+			for (nch = 0; nch < sp->numChans; nch++)
+			{
+				size_t offset = seqChan[nch].offset;
+
+				ss->chanOffset[nch] = NO_OFFSET;
+				for (nf = 0; nf < ss->numVarFields; nf++)
+				{
+					seqVarField *vf = ss->varFields + nf;
+
+					if (offset >= vf->offset && offset < vf->offset + vf->size)
+					{
+						ss->chanOffset[nch] = vf->localOffset + (offset - vf->offset);
+						break;
+					}
+				}
+			}
+		}
+		if (ss->varSize > 0)
 		{
-			ss->var = (SEQ_VARS *)newArray(char, sp->varSize);
+			ss->var = (SEQ_VARS *)newArray(char, ss->varSize);
 			if (!ss->var)
 			{
 				errlogSevPrintf(errlogFatal, "init_sscb: calloc failed\n");
@@ -349,6 +436,7 @@ static boolean init_sscb(PROG *sp, SSCB *ss, seqSS *seqSS)
 	else
 	{
 		ss->dirty = NULL;
+		ss->getDone = NULL;
 		ss->var = sp->var;
 	}
 	return TRUE;
@@ -367,12 +455,7 @@ static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan)
 	if (ch->count == 0) ch->count = 1;
 	ch->syncedTo = seqChan->efId;
 	if (ch->syncedTo)
-	{
-		/* insert into syncedTo list for this event flag */
-		CHAN *fst = sp->syncedChans[ch->syncedTo];
-		sp->syncedChans[ch->syncedTo] = ch;
-		ch->nextSynced = fst;
-	}
+		bitSet(syncedMask(sp, ch->syncedTo), chNum(ch));
 	ch->monitored = seqChan->monitored;
 	ch->eventNum = seqChan->eventNum;
 
@@ -429,9 +512,41 @@ static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan)
 		size_t size = pv_size_n(ch->type->getType, ch->count);
 		QUEUE *q = sp->queues + seqChan->queueIndex;
 
+		/* With +T, a put waiting for space would also keep
+		   the reader, which runs in the same thread, from
+		   making any */
+		if (seqChan->queuePolicy == SYNCQ_BLOCK && !ch->dbch
+			&& optTest(sp, OPT_COOP))
+		{
+			errlogSevPrintf(errlogFatal,
+				"init_chan(varname=%s): queue policy block "
+				"cannot be used with option +T\n",
+				seqChan->varName);
+			return FALSE;
+		}
+
 		if (*q == NULL)
 		{
-			*q = seqQueueCreate(seqChan->queueSize, size);
+			static const enum seqQueuePolicy policy[] = {
+				seqQueueOverwriteLast,	/* SYNCQ_OVERWRITE_LAST */
+				seqQueueDropOldest,	/* SYNCQ_DROP_OLDEST */
+				seqQueueDropNewest,	/* SYNCQ_DROP_NEWEST */
+				seqQueueDropNewest	/* SYNCQ_BLOCK */
+			};
+
+			if ((unsigned)seqChan->queuePolicy > SYNCQ_BLOCK)
+			{
+				errlogSevPrintf(errlogFatal,
+					"init_chan(varname=%s): invalid queue policy\n",
+					seqChan->varName);
+				return FALSE;
+			}
+			if (seqChan->queueBytes)
+				*q = seqQueueCreateBytes(seqChan->queueSize, size,
+					policy[seqChan->queuePolicy]);
+			else
+				*q = seqQueueCreatePolicy(seqChan->queueSize, size,
+					policy[seqChan->queuePolicy]);
 			if (!*q)
 			{
 				errlogSevPrintf(errlogFatal, "init_chan: seqQueueCreate failed\n");
@@ -447,16 +562,38 @@ static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan)
 			return FALSE;
 		}
 		ch->queue = *q;
-		DEBUG("  queueSize=%d, queueIndex=%d, queue=%p\n",
-			seqChan->queueSize, seqChan->queueIndex, ch->queue);
+		ch->queuePolicy = seqChan->queuePolicy;
+		ch->queueBytes = seqChan->queueBytes;
+		ch->queueWatermark = seqChan->queueWatermark;
+		ch->queueTimeout = seqChan->queueTimeout;
+		if (ch->queueWatermark > 1 && ch->queueTimeout > 0.0)
+		{
+			ch->queueTimer = epicsTimerQueueCreateTimer(sp->timerQueue,
+				ss_queue_timer_expired, ch);
+			if (!ch->queueTimer)
+			{
+				errlogSevPrintf(errlogFatal,
+					"init_chan: epicsTimerQueueCreateTimer failed\n");
+				return FALSE;
+			}
+		}
+		DEBUG("  queueSize=%d, queueIndex=%d, queuePolicy=%d, queueBytes=%d, queue=%p\n",
+			seqChan->queueSize, seqChan->queueIndex, seqChan->queuePolicy,
+			seqChan->queueBytes, ch->queue);
+		DEBUG("  queueWatermark=%d, queueTimeout=%g\n",
+			ch->queueWatermark, ch->queueTimeout);
 		DEBUG("  queue->numElems=%d, queue->elemSize=%d\n",
 			seqQueueNumElems(ch->queue), seqQueueElemSize(ch->queue));
 	}
-	ch->varLock = epicsMutexCreate();
-	if (!ch->varLock)
+	/* Lock-free buffers need no mutex */
+	if (!optTest(sp, OPT_LOCKFREE))
 	{
-		errlogSevPrintf(errlogFatal, "init_chan: epicsMutexCreate failed\n");
-		return FALSE;
+		ch->varLock = epicsMutexCreate();
+		if (!ch->varLock)
+		{
+			errlogSevPrintf(errlogFatal, "init_chan: epicsMutexCreate failed\n");
+			return FALSE;
+		}
 	}
 	return TRUE;
 }
@@ -471,20 +608,36 @@ void seq_free(PROG *sp)
 	{
 		SSCB *ss = sp->ss + nss;
 
-		epicsEventDestroy(ss->syncSem);
+		epicsTimerQueueDestroyTimer(sp->timerQueue, ss->wakeupTimer);
+		if (nss == 0 || !optTest(sp, OPT_COOP))
+			epicsEventDestroy(ss->syncSem);
+		free(ss->pending);
+		free(ss->changed);
 		free(ss->metaData);
 
 		epicsEventDestroy(ss->dead);
 
 		if (optTest(sp, OPT_SAFE)) free(ss->dirty);
+		if (optTest(sp, OPT_SAFE)) free(ss->getDone);
 		if (optTest(sp, OPT_SAFE)) free(ss->var);
+		if (optTest(sp, OPT_SAFE)) free(ss->chanOffset);
 	}
 
 	free(sp->ss);
 
+	/* Delete queue timers before releasing the timer queue */
+	for (nch = 0; nch < sp->numChans; nch++)
+	{
+		CHAN *ch = sp->chan + nch;
+
+		if (ch->queueTimer)
+			epicsTimerQueueDestroyTimer(sp->timerQueue, ch->queueTimer);
+	}
+
 	/* Delete program-wide semaphores */
 	epicsMutexDestroy(sp->lock);
 	epicsEventDestroy(sp->ready);
+	epicsTimerQueueRelease(sp->timerQueue);
 
 	seqMacFree(sp);
 
@@ -497,6 +650,8 @@ void seq_free(PROG *sp)
 			free(ch->dbch->dbName);
 			free(ch->dbch);
 		}
+		if (ch->varLock)
+			epicsMutexDestroy(ch->varLock);
 	}
 	free(sp->chan);
 
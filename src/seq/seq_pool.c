@@ -0,0 +1,256 @@
+/*************************************************************************\
+Copyright (c) 2010-2015 Helmholtz-Zentrum Berlin f. Materialien
+                        und Energie GmbH, Germany (HZB)
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*************************************************************************\
+                        Worker pool for state sets
+
+State sets of programs started with the "pool" parameter do not get a
+thread of their own. Instead, whenever one of them has a pending event,
+it is put on a ready queue, from which a pool of worker threads takes it
+to do (at most) one transition. The queue is ordered by program
+priority, and a worker runs at the priority of the state set it
+executes. There is one pool per pv system, so that each worker stays
+attached to the pv system of all the state sets it runs.
+
+Each state set is in one of the states below. A wakeup while a worker
+executes the state set makes sure it gets queued again afterwards, so
+that it is never on the queue twice nor executed by two workers at once.
+\*************************************************************************/
+#include "epicsVersion.h"
+
+#include "seq.h"
+#include "seq_debug.h"
+
+#define POOL_NEW        0   /* not yet started */
+#define POOL_IDLE       1   /* waiting for events */
+#define POOL_QUEUED     2   /* on the ready queue */
+#define POOL_RUNNING    3   /* being executed by a worker */
+#define POOL_RERUN      4   /* ditto, and woken up in the meantime */
+#define POOL_DONE       5   /* has exited */
+
+#define NUM_PRIO        (THREAD_PRIORITY + 1)
+
+struct worker_pool
+{
+    POOL            *next;
+    pvSystem        pvSys;          /* workers are attached to this */
+    epicsMutexId    lock;           /* protects the queue */
+    epicsEventId    work;           /* signalled when the queue is not empty */
+    SSCB            *head[NUM_PRIO];/* ready queue, one list per priority */
+    SSCB            *tail[NUM_PRIO];
+    unsigned        top;            /* no state set has higher priority */
+    unsigned        numWorkers;
+};
+
+static struct
+{
+    epicsMutexId    lock;           /* protects the list */
+    POOL            *first;
+} pools;
+
+static void poolWorker(void *arg);
+
+static unsigned poolNumWorkers(void)
+{
+#if (EPICS_VERSION == 3) && (EPICS_REVISION < 15)
+    return 4;
+#else
+    return epicsThreadGetCPUs();
+#endif
+}
+
+static void poolInit(void *arg)
+{
+    pools.lock = epicsMutexCreate();
+    if (!pools.lock) {
+        errlogSevPrintf(errlogFatal, "poolInit: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void poolLazyInit(void)
+{
+    static epicsThreadOnceId poolOnceFlag = EPICS_THREAD_ONCE_INIT;
+    epicsThreadOnce(&poolOnceFlag, poolInit, NULL);
+}
+
+/* Create a pool and its workers for pv system pvSys */
+static POOL *poolCreate(pvSystem pvSys)
+{
+    POOL *pool = new(POOL);
+    unsigned n;
+
+    if (!pool
+        || !(pool->lock = epicsMutexCreate())
+        || !(pool->work = epicsEventCreate(epicsEventEmpty))) {
+        errlogSevPrintf(errlogFatal, "poolCreate: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    pool->pvSys = pvSys;
+    pool->numWorkers = poolNumWorkers();
+    for (n = 0; n < pool->numWorkers; n++) {
+        char name[THREAD_NAME_SIZE];
+
+        sprintf(name, "seqPool_%.8s_%u", pvSysGetName(pvSys), n);
+        if (!epicsThreadCreate(name, THREAD_PRIORITY,
+            epicsThreadGetStackSize(THREAD_STACK_SIZE), poolWorker, pool)) {
+            errlogSevPrintf(errlogFatal, "poolCreate: epicsThreadCreate failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    DEBUG("poolCreate: started %u workers for pv system %s\n",
+        pool->numWorkers, pvSysGetName(pvSys));
+    return pool;
+}
+
+/* Find the pool for pv system pvSys, creating it if necessary */
+static POOL *poolFind(pvSystem pvSys)
+{
+    POOL *pool;
+
+    poolLazyInit();
+    epicsMutexMustLock(pools.lock);
+    foreach (pool, pools.first) {
+        if (pool->pvSys.id == pvSys.id)
+            break;
+    }
+    if (!pool) {
+        pool = poolCreate(pvSys);
+        pool->next = pools.first;
+        pools.first = pool;
+    }
+    epicsMutexUnlock(pools.lock);
+    return pool;
+}
+
+static void poolEnqueue(POOL *pool, SSCB *ss)
+{
+    unsigned prio = ss->prog->threadPriority;
+
+    epicsMutexMustLock(pool->lock);
+    ss->poolNext = NULL;
+    if (pool->tail[prio])
+        pool->tail[prio]->poolNext = ss;
+    else
+        pool->head[prio] = ss;
+    pool->tail[prio] = ss;
+    if (prio > pool->top)
+        pool->top = prio;
+    epicsMutexUnlock(pool->lock);
+    epicsEventSignal(pool->work);
+}
+
+static boolean poolIsEmpty(POOL *pool)
+{
+    while (!pool->head[pool->top]) {
+        if (pool->top == 0)
+            return TRUE;
+        pool->top--;
+    }
+    return FALSE;
+}
+
+/* Remove the first state set with the highest priority, or return NULL */
+static SSCB *poolDequeue(POOL *pool)
+{
+    SSCB *ss;
+
+    if (poolIsEmpty(pool))
+        return NULL;
+    ss = pool->head[pool->top];
+    pool->head[pool->top] = ss->poolNext;
+    if (!ss->poolNext)
+        pool->tail[pool->top] = NULL;
+    return ss;
+}
+
+static void poolWorker(void *arg)
+{
+    POOL *pool = (POOL *)arg;
+    unsigned prio = THREAD_PRIORITY;
+
+    pvSysAttach(pool->pvSys);
+    epicsMutexMustLock(pool->lock);
+    while (TRUE) {
+        SSCB *ss = poolDequeue(pool);
+        boolean more;
+        enum ss_step step;
+
+        if (!ss) {
+            epicsMutexUnlock(pool->lock);
+            epicsEventMustWait(pool->work);
+            epicsMutexMustLock(pool->lock);
+            continue;
+        }
+        /* the event wakes only one of us, so pass it on */
+        more = !poolIsEmpty(pool);
+        epicsMutexUnlock(pool->lock);
+        if (more)
+            epicsEventSignal(pool->work);
+
+        if (ss->prog->threadPriority != prio) {
+            prio = ss->prog->threadPriority;
+            epicsThreadSetPriority(epicsThreadGetIdSelf(), prio);
+        }
+        /* must be atomic, so that a wakeup either sees that we are
+           running, or we see its pending event */
+        seqAtomicCas(&ss->poolState, POOL_QUEUED, POOL_RUNNING);
+        step = ss_pool_step(ss);
+        if (step == SS_STEP_EXIT) {
+            ss->poolState = POOL_DONE;
+            /* the program may be freed as soon as we signal this */
+            epicsEventSignal(ss->dead);
+        } else if (step == SS_STEP_AGAIN
+            || seqAtomicCas(&ss->poolState, POOL_RUNNING, POOL_IDLE) != POOL_RUNNING) {
+            /* go to the end of the queue to give others a chance */
+            ss->poolState = POOL_QUEUED;
+            poolEnqueue(pool, ss);
+        }
+        epicsMutexMustLock(pool->lock);
+    }
+}
+
+/*
+ * seqPoolStart() - Hand the state sets of program sp to the pool for
+ * its pv system.
+ */
+void seqPoolStart(PROG *sp)
+{
+    unsigned nss;
+
+    sp->pool = poolFind(sp->pvSys);
+    for (nss = 0; nss < sp->numSS; nss++) {
+        SSCB *ss = sp->ss + nss;
+
+        /* events before this point are still pending */
+        ss->poolState = POOL_QUEUED;
+        poolEnqueue(sp->pool, ss);
+    }
+}
+
+/*
+ * seqPoolWakeup() - Called after an event for state set ss was recorded
+ * as pending: make sure a worker will look at it.
+ */
+void seqPoolWakeup(SSCB *ss)
+{
+    while (TRUE) {
+        switch (ss->poolState) {
+        case POOL_IDLE:
+            if (seqAtomicCas(&ss->poolState, POOL_IDLE, POOL_QUEUED) == POOL_IDLE) {
+                poolEnqueue(ss->prog->pool, ss);
+                return;
+            }
+            break;
+        case POOL_RUNNING:
+            if (seqAtomicCas(&ss->poolState, POOL_RUNNING, POOL_RERUN) == POOL_RUNNING)
+                return;
+            break;
+        default:
+            return;
+        }
+    }
+}
@@ -0,0 +1,411 @@
+/*************************************************************************\
+Copyright (c) 2010-2015 Helmholtz-Zentrum Berlin f. Materialien
+                        und Energie GmbH, Germany (HZB)
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*************************************************************************\
+                        Shared PV registry
+
+All channels in the process that are assigned to the same PV name (in
+the same pv system) share one pv layer channel, and all that monitor it with the same type and
+count share one subscription. Connection and monitor events are passed
+on to each channel. A channel that joins a connected PV gets a connect
+event right away, and one that joins an existing subscription gets the
+last value received, so it does not have to wait for the next change.
+
+Lock order: the registry lock before a PV's lock before sp->lock. The
+pv layer's callbacks take the PV's lock, so it must not be held while
+calling pvVarDestroy or pvVarMonitorOff, which wait for callbacks in
+progress to complete. For the same reason, and because it takes sp->lock
+and may subscribe or unsubscribe, the sequencer's connection handler is
+called without the PV's lock. Instead, the PV is marked busy meanwhile,
+which keeps its list of users from changing.
+\*************************************************************************/
+#include "gpHash.h"
+
+#include "seq.h"
+#include "seq_debug.h"
+
+struct shared_pv
+{
+    char            *name;
+    pvVar           var;        /* the one pv layer channel */
+    unsigned        refCount;   /* number of channels using it */
+    epicsMutexId    lock;       /* protects the members below */
+    boolean         connected;
+    boolean         busy;       /* connection handlers are being called */
+    CHAN            *users;     /* channels using this pv */
+    SHAREDMON       *mons;      /* monitor subscriptions */
+};
+
+struct shared_monitor
+{
+    SHAREDMON       *next;
+    SHAREDPV        *pv;
+    pvType          type;
+    unsigned        count;
+    pvVar           var;        /* copy of pv->var with our own monid */
+    CHAN            *users;     /* channels using this subscription */
+    /* last monitor event, for channels that join later */
+    boolean         haveLast;
+    pvType          lastType;
+    unsigned        lastCount;
+    pvStat          lastStatus;
+    size_t          lastSize;
+    void            *last;
+};
+
+static struct
+{
+    epicsMutexId    lock;
+    epicsEventId    idle;       /* some PV is no longer busy */
+    struct gphPvt   *table;
+} registry;
+
+static void registryInit(void *arg)
+{
+    registry.lock = epicsMutexCreate();
+    if (!registry.lock) {
+        errlogSevPrintf(errlogFatal, "registryInit: epicsMutexCreate failed\n");
+        exit(EXIT_FAILURE);
+    }
+    registry.idle = epicsEventMustCreate(epicsEventEmpty);
+    gphInitPvt(&registry.table, 1024);
+}
+
+static void registryLazyInit(void)
+{
+    static epicsThreadOnceId registryOnceFlag = EPICS_THREAD_ONCE_INIT;
+    epicsThreadOnce(&registryOnceFlag, registryInit, NULL);
+}
+
+/* Remove ch from a list of channels linked through member next */
+#define unlinkUser(list, ch, next) {\
+    CHAN **_pp = &(list);\
+    while (*_pp && *_pp != (ch)) _pp = &(*_pp)->next;\
+    if (*_pp) *_pp = (ch)->next;\
+}
+
+/* Wait until pv is no longer busy; called with its lock held */
+static void waitIdle(SHAREDPV *pv)
+{
+    while (pv->busy) {
+        epicsMutexUnlock(pv->lock);
+        /* there may be more than one waiter, so poll */
+        epicsEventWaitWithTimeout(registry.idle, 0.01);
+        epicsMutexMustLock(pv->lock);
+    }
+}
+
+static void setIdle(SHAREDPV *pv)
+{
+    epicsMutexMustLock(pv->lock);
+    pv->busy = FALSE;
+    epicsMutexUnlock(pv->lock);
+    epicsEventSignal(registry.idle);
+}
+
+static void sharedConnHandler(int connected, void *arg)
+{
+    SHAREDPV *pv = (SHAREDPV *)arg;
+    CHAN *ch;
+
+    epicsMutexMustLock(pv->lock);
+    waitIdle(pv);
+    pv->connected = connected;
+    pv->busy = TRUE;
+    epicsMutexUnlock(pv->lock);
+    for (ch = pv->users; ch; ch = ch->nextUser)
+        seq_conn_handler(connected, ch);
+    setIdle(pv);
+}
+
+static void sharedEventHandler(pvEventType evt, void *arg,
+    pvType type, unsigned count, pvValue *value, pvStat status)
+{
+    SHAREDMON *mon;
+    CHAN *ch;
+
+    if (evt != pvEventMonitor) {
+        /* get and put requests are not shared */
+        seq_event_handler(evt, arg, type, count, value, status);
+        return;
+    }
+    mon = (SHAREDMON *)arg;
+    epicsMutexMustLock(mon->pv->lock);
+    /* remember the value for channels that join later */
+    mon->haveLast = FALSE;
+    if (value) {
+        size_t size = pv_size_n(type, count);
+
+        if (size > mon->lastSize) {
+            free(mon->last);
+            mon->last = newArray(char, size);
+            mon->lastSize = mon->last ? size : 0;
+        }
+        if (mon->last) {
+            memcpy(mon->last, value, size);
+            mon->lastType = type;
+            mon->lastCount = count;
+            mon->lastStatus = status;
+            mon->haveLast = TRUE;
+        }
+    }
+    for (ch = mon->users; ch; ch = ch->nextMonUser) {
+        seq_event_handler(evt, ch, type, count, value, status);
+    }
+    epicsMutexUnlock(mon->pv->lock);
+}
+
+static pvStat monitor_on(CHAN *ch);
+
+/*
+ * seqPvCreate() - Assign channel ch to the PV named ch->dbch->dbName,
+ * creating the pv layer channel if no other channel uses it yet, and
+ * subscribe it if it is monitored. The caller must not hold sp->lock.
+ */
+pvStat seqPvCreate(CHAN *ch)
+{
+    DBCHAN *dbch = ch->dbch;
+    PROG *sp = ch->prog;
+    GPHENTRY *entry;
+    SHAREDPV *pv;
+    boolean connected;
+
+    registryLazyInit();
+    epicsMutexMustLock(registry.lock);
+    entry = gphFind(registry.table, dbch->dbName, (void *)sp->pvSys.backend);
+    if (entry) {
+        pv = (SHAREDPV *)entry->userPvt;
+        epicsMutexMustLock(pv->lock);
+    } else {
+        pvStat status;
+
+        pv = new(SHAREDPV);
+        if (pv)
+            pv->name = epicsStrDup(dbch->dbName);
+        if (pv)
+            pv->lock = epicsMutexCreate();
+        if (!pv || !pv->name || !pv->lock) {
+            errlogSevPrintf(errlogFatal, "seqPvCreate: out of memory\n");
+            if (pv) {
+                if (pv->lock) epicsMutexDestroy(pv->lock);
+                free(pv->name);
+                free(pv);
+            }
+            epicsMutexUnlock(registry.lock);
+            return pvStatERROR;
+        }
+        /* callbacks wait until we have added ch */
+        epicsMutexMustLock(pv->lock);
+        status = pvVarCreate(sp->pvSys, pv->name,
+            sharedConnHandler, sharedEventHandler, pv, &pv->var);
+        if (status != pvStatOK) {
+            /* hand the error message to the caller */
+            dbch->pvid = pv->var;
+            epicsMutexUnlock(pv->lock);
+            epicsMutexDestroy(pv->lock);
+            free(pv->name);
+            free(pv);
+            epicsMutexUnlock(registry.lock);
+            return status;
+        }
+        entry = gphAdd(registry.table, pv->name, (void *)sp->pvSys.backend);
+        assert(entry);
+        entry->userPvt = pv;
+    }
+    pv->refCount++;
+    epicsMutexUnlock(registry.lock);
+
+    DEBUG("seqPvCreate: %s uses %s (refCount=%u)\n", ch->varName,
+        pv->name, pv->refCount);
+    waitIdle(pv);
+    dbch->pv = pv;
+    dbch->mon = NULL;
+    /* requests go directly to the shared channel */
+    dbch->pvid = pv->var;
+    dbch->pvid.monid = NULL;
+    ch->nextUser = pv->users;
+    pv->users = ch;
+    connected = pv->connected;
+    /* Subscribe before any connection handler call for ch, so that
+       the handler only has to resubscribe after a disconnect. But if
+       the PV is already connected, leave it to the handler below: the
+       last value it replays must not arrive before the handler has
+       set dbch->dbCount, or ch would get no elements at all. */
+    if (!connected && ch->monitored && monitor_on(ch) != pvStatOK)
+        errlogSevPrintf(errlogFatal, "seqPvCreate(var '%s', pv '%s'): "
+            "pvVarMonitorOn() failure: %s\n", ch->varName, dbch->dbName,
+            pvVarGetMess(dbch->pvid));
+    /* if the PV is already connected, tell ch, as sharedConnHandler
+       would have done */
+    pv->busy = connected;
+    epicsMutexUnlock(pv->lock);
+    if (connected) {
+        seq_conn_handler(TRUE, ch);
+        setIdle(pv);
+    }
+    return pvStatOK;
+}
+
+static pvStat monitor_off(CHAN *ch, DBCHAN *dbch);
+
+/*
+ * seqPvDestroy() - Remove channel ch from the PV of dbch (which need not
+ * be ch->dbch any more), including its monitor, and destroy the pv layer
+ * channel if ch was the last one using it. The caller must not hold
+ * sp->lock.
+ */
+pvStat seqPvDestroy(CHAN *ch, DBCHAN *dbch)
+{
+    SHAREDPV *pv = dbch->pv;
+    pvStat status = pvStatOK;
+
+    if (!pv)
+        return pvStatOK;
+    monitor_off(ch, dbch);
+
+    epicsMutexMustLock(registry.lock);
+    epicsMutexMustLock(pv->lock);
+    waitIdle(pv);
+    unlinkUser(pv->users, ch, nextUser);
+    dbch->pv = NULL;
+    dbch->pvid = nullPvVar;
+    if (--pv->refCount > 0) {
+        epicsMutexUnlock(pv->lock);
+        epicsMutexUnlock(registry.lock);
+        return pvStatOK;
+    }
+    gphDelete(registry.table, pv->name, (void *)ch->prog->pvSys.backend);
+    epicsMutexUnlock(pv->lock);
+    epicsMutexUnlock(registry.lock);
+
+    DEBUG("seqPvDestroy: destroy %s\n", pv->name);
+    status = pvVarDestroy(&pv->var);
+    if (status != pvStatOK)
+        dbch->pvid.msg = pvVarGetMess(pv->var);
+    assert(!pv->mons);
+    epicsMutexDestroy(pv->lock);
+    free(pv->name);
+    free(pv);
+    return status;
+}
+
+/*
+ * seqPvMonitorOn() - Subscribe channel ch, sharing the subscription with
+ * other channels of the same PV that use the same type and count.
+ */
+pvStat seqPvMonitorOn(CHAN *ch)
+{
+    SHAREDPV *pv = ch->dbch->pv;
+    pvStat status;
+
+    assert(pv);
+    epicsMutexMustLock(pv->lock);
+    status = monitor_on(ch);
+    epicsMutexUnlock(pv->lock);
+    return status;
+}
+
+/* Called with the PV's lock held */
+static pvStat monitor_on(CHAN *ch)
+{
+    DBCHAN *dbch = ch->dbch;
+    SHAREDPV *pv = dbch->pv;
+    SHAREDMON *mon;
+    pvType type = ch->type->getType;
+    /* byte queues store only what we get */
+    unsigned count = ch->queueBytes ? 0 : ch->count;
+
+    if (dbch->mon)
+        return pvStatOK;
+    foreach (mon, pv->mons) {
+        if (mon->type == type && mon->count == count)
+            break;
+    }
+    if (!mon) {
+        pvStat status;
+
+        mon = new(SHAREDMON);
+        if (!mon) {
+            errlogSevPrintf(errlogFatal, "seqPvMonitorOn: out of memory\n");
+            return pvStatERROR;
+        }
+        mon->pv = pv;
+        mon->type = type;
+        mon->count = count;
+        mon->var = pv->var;
+        mon->var.monid = NULL;
+        status = pvVarMonitorOn(&mon->var, type, count, mon);
+        if (status != pvStatOK) {
+            dbch->pvid.msg = pvVarGetMess(mon->var);
+            free(mon);
+            return status;
+        }
+        mon->next = pv->mons;
+        pv->mons = mon;
+    }
+    dbch->mon = mon;
+    ch->nextMonUser = mon->users;
+    mon->users = ch;
+    if (mon->haveLast)
+        seq_event_handler(pvEventMonitor, ch, mon->lastType, mon->lastCount,
+            (pvValue *)mon->last, mon->lastStatus);
+    return pvStatOK;
+}
+
+/*
+ * seqPvMonitorOff() - Unsubscribe channel ch, and cancel the subscription
+ * if no other channel uses it.
+ */
+pvStat seqPvMonitorOff(CHAN *ch)
+{
+    return monitor_off(ch, ch->dbch);
+}
+
+static pvStat monitor_off(CHAN *ch, DBCHAN *dbch)
+{
+    SHAREDPV *pv = dbch->pv;
+    SHAREDMON *mon;
+    pvStat status;
+
+    if (!pv)
+        return pvStatOK;
+    epicsMutexMustLock(pv->lock);
+    mon = dbch->mon;
+    if (!mon) {
+        epicsMutexUnlock(pv->lock);
+        return pvStatOK;
+    }
+    unlinkUser(mon->users, ch, nextMonUser);
+    dbch->mon = NULL;
+    if (mon->users) {
+        epicsMutexUnlock(pv->lock);
+        return pvStatOK;
+    }
+    {
+        SHAREDMON **pp = &pv->mons;
+
+        while (*pp != mon)
+            pp = &(*pp)->next;
+        *pp = mon->next;
+    }
+    epicsMutexUnlock(pv->lock);
+
+    status = pvVarMonitorOff(&mon->var);
+    if (status != pvStatOK)
+        dbch->pvid.msg = pvVarGetMess(mon->var);
+    free(mon->last);
+    free(mon);
+    return status;
+}
+
+/*
+ * seqPvGetMess() - Error message for the last event of the PV that
+ * channel ch is assigned to.
+ */
+const char *seqPvGetMess(CHAN *ch)
+{
+    return ch->dbch->pv ? pvVarGetMess(ch->dbch->pv->var) : NULL;
+}
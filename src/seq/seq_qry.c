@@ -107,7 +107,7 @@ epicsShareFunc void epicsShareAPI seqShow(epicsThreadId tid)
 
 		if (optTest(sp, OPT_SAFE))
 			printf("  User variables: address = %p, length = %u\n",
-				sp->var, (unsigned)sp->varSize);
+				ss->var, (unsigned)ss->varSize);
 		printf("\n");
 	}
 }
@@ -174,7 +174,10 @@ epicsShareFunc void epicsShareAPI seqChanShow(epicsThreadId tid, const char *str
 		printf("    type = %s\n", prim_type_name[ch->type->tag]);
 		printf("    count = %u\n", ch->count);
 		printf("  Value =");
-		printValue(printf, valPtr(ch,ss), ch->count, ch->type->putType);
+		if (hasVal(ch,ss))
+			printValue(printf, valPtr(ch,ss), ch->count, ch->type->putType);
+		else
+			printf(" (not used by this state set)\n");
 
 		if (dbch)
 			printf("  Assigned to \"%s\"\n", dbch->dbName);
@@ -314,6 +317,10 @@ epicsShareFunc void epicsShareAPI seqQueueShow(epicsThreadId tid)
 			(unsigned)seqQueueNumElems(queue),
 			(unsigned)seqQueueUsed(queue),
 			(unsigned)seqQueueElemSize(queue));
+		printf("    put=%.0f, dropped=%.0f, highWater=%u\n",
+			(double)seqQueueNumPut(queue),
+			(double)seqQueueNumDropped(queue),
+			(unsigned)seqQueueHighWater(queue));
 		dn = userInput();
 		nq += dn;
 	}
@@ -7,29 +7,255 @@ in the file LICENSE that is included with this distribution.
 #include "seq.h"
 #include "seq_debug.h"
 
+/*
+ * Each cell has a sequence number that tells what it contains, in terms
+ * of the (monotonic, never wrapping) put position pos it belongs to:
+ *
+ *  2*pos       empty, may be claimed by the put at position pos
+ *  2*pos+1     contains the element put at position pos
+ *  CELL_BUSY   being read by a get, or being overwritten by a put
+ *
+ * A put claims a cell by advancing wr, a get claims it by marking it
+ * busy; so any number of readers and writers can use the queue
+ * concurrently. After reading, a get marks the cell empty for the put
+ * that will reuse it, i.e. 2*(pos+numElems).
+ *
+ * Byte queues (see seqQueueCreateBytes) instead store length-prefixed
+ * records of varying size in a ring of numElems bytes. A record never
+ * wraps around; if it does not fit at the end of the buffer, the rest
+ * is skipped (marked with REC_SKIP if there is room for a header). Byte
+ * queues are protected by a mutex, since records are typically large
+ * and the time to copy them dominates.
+ */
+#define CELL_BUSY   (~(seqUInt64)0)
+
+/* separate the indices to avoid false sharing between reader and writers */
+#define CACHE_LINE  64
+
 struct seqQueue {
-    size_t          wr;
-    size_t          rd;
-    size_t          numElems;
-    size_t          elemSize;
-    boolean         overflow;
-    epicsMutexId    mutex;
-    char            *buffer;
+    size_t              numElems;
+    boolean             pow2;       /* numElems is a power of two */
+    enum seqQueuePolicy policy;
+    size_t              elemSize;
+    seqUInt64           *seq;
+    char                *buffer;
+    char                pad1[CACHE_LINE];
+    volatile seqUInt64  wr;
+    volatile seqUInt64  numDropped; /* statistics, updated by writers */
+    volatile seqUInt64  highWater;
+    char                pad2[CACHE_LINE - 3 * sizeof(seqUInt64)];
+    volatile seqUInt64  rd;
+    char                pad3[CACHE_LINE - sizeof(seqUInt64)];
+    /* only for byte queues, protected by lock */
+    epicsMutexId        lock;       /* NULL for fixed size queues */
+    size_t              rdPos;      /* first record (or skipped space) */
+    size_t              wrPos;      /* end of last record */
+    size_t              lastPos;    /* last record */
+    size_t              numRecs;    /* number of records */
+    size_t              numBytes;   /* bytes used, including skipped space */
 };
 
+typedef union {
+    size_t              len;        /* length of record data in bytes */
+    double              align;
+} recHeader;
+
+#define REC_HDR             sizeof(recHeader)
+#define REC_SKIP            ((size_t)-1)
+#define recSize(len)        (REC_HDR + ((len) + REC_HDR - 1) / REC_HDR * REC_HDR)
+#define recPtr(q,pos)       ((recHeader *)((q)->buffer + (pos)))
+#define recData(q,pos)      ((q)->buffer + (pos) + REC_HDR)
+#define NOWHERE             ((size_t)-1)
+
+/* if numElems is a power of two, avoid the (64 bit) division */
+#define cellIndex(q,pos)    ((q)->pow2 \
+                            ? (size_t)(pos) & ((q)->numElems - 1) \
+                            : (size_t)((pos) % (q)->numElems))
+#define cellPtr(q,pos)      ((q)->buffer + cellIndex(q,pos) * (q)->elemSize)
+#define cellSeq(q,pos)      ((q)->seq + cellIndex(q,pos))
+
+static size_t used(const QUEUE q)
+{
+    seqUInt64 rd, wr, n;
+
+    if (q->lock) {
+        size_t numBytes;
+
+        epicsMutexMustLock(q->lock);
+        numBytes = q->numBytes;
+        epicsMutexUnlock(q->lock);
+        return numBytes;
+    }
+    /* load rd first, so that wr >= rd */
+    rd = seqAtomicLoad64(&q->rd);
+    wr = seqAtomicLoad64(&q->wr);
+    n = wr - rd;
+    return n > q->numElems ? q->numElems : (size_t)n;
+}
+
+static void add64(volatile seqUInt64 *p, seqUInt64 v)
+{
+    seqUInt64 old = seqAtomicLoad64(p), cur;
+
+    while ((cur = seqAtomicCas64(p, old, old + v)) != old)
+        old = cur;
+}
+
+/* called after the element at position wr has been put */
+static void update_high_water(QUEUE q, seqUInt64 wr)
+{
+    seqUInt64 rd = seqAtomicLoad64(&q->rd);
+    seqUInt64 n = rd > wr ? 0 : wr + 1 - rd;
+    seqUInt64 hw = seqAtomicLoad64(&q->highWater), cur;
+
+    if (n > q->numElems)
+        n = q->numElems;
+    while (n > hw && (cur = seqAtomicCas64(&q->highWater, hw, n)) != hw)
+        hw = cur;
+}
+
+static void *discard(void *dest, const void *src, size_t elemSize)
+{
+    return dest;
+}
+
+/* Byte queues */
+
+static void ring_reset(QUEUE q)
+{
+    q->rdPos = q->wrPos = q->lastPos = 0;
+    q->numRecs = q->numBytes = 0;
+}
+
+/* Where a record of the given size can be put, or NOWHERE */
+static size_t ring_place(QUEUE q, size_t size)
+{
+    if (q->numRecs == 0)
+        return size <= q->numElems ? 0 : NOWHERE;
+    if (q->wrPos > q->rdPos) {
+        if (size <= q->numElems - q->wrPos)
+            return q->wrPos;
+        return size <= q->rdPos ? 0 : NOWHERE;
+    }
+    return size <= q->rdPos - q->wrPos ? q->wrPos : NOWHERE;
+}
+
+/* Skip unused space at the end of the buffer before the first record */
+static void ring_skip(QUEUE q)
+{
+    size_t rest = q->numElems - q->rdPos;
+
+    if (rest < REC_HDR || recPtr(q, q->rdPos)->len == REC_SKIP) {
+        q->numBytes -= rest;
+        q->rdPos = 0;
+    }
+}
+
+static void ring_remove_first(QUEUE q)
+{
+    size_t size;
+
+    ring_skip(q);
+    size = recSize(recPtr(q, q->rdPos)->len);
+    q->rdPos += size;
+    q->numBytes -= size;
+    if (--q->numRecs == 0)
+        ring_reset(q);
+}
+
+static void ring_remove_last(QUEUE q)
+{
+    q->numBytes -= recSize(recPtr(q, q->lastPos)->len);
+    q->wrPos = q->lastPos;
+    if (--q->numRecs == 0)
+        ring_reset(q);
+}
+
+static boolean ring_put(QUEUE q, seqQueueFunc *put, const void *arg, size_t len)
+{
+    size_t size = recSize(len), pos;
+    boolean lost = FALSE;
+
+    epicsMutexMustLock(q->lock);
+    pos = ring_place(q, size);
+    if (pos == NOWHERE && q->policy == seqQueueOverwriteLast) {
+        ring_remove_last(q);
+        add64(&q->numDropped, 1);
+        lost = TRUE;
+        pos = ring_place(q, size);
+    }
+    if (pos == NOWHERE && q->policy == seqQueueDropNewest) {
+        epicsMutexUnlock(q->lock);
+        add64(&q->numDropped, 1);
+        return TRUE;
+    }
+    /* remove as many old records as needed */
+    while (pos == NOWHERE) {
+        ring_remove_first(q);
+        add64(&q->numDropped, 1);
+        lost = TRUE;
+        pos = ring_place(q, size);
+    }
+    if (pos < q->wrPos) {
+        /* skip the rest of the buffer */
+        if (q->numElems - q->wrPos >= REC_HDR)
+            recPtr(q, q->wrPos)->len = REC_SKIP;
+        q->numBytes += q->numElems - q->wrPos;
+    }
+    recPtr(q, pos)->len = len;
+    put(recData(q, pos), arg, len);
+    q->lastPos = pos;
+    q->wrPos = pos + size;
+    q->numRecs++;
+    q->numBytes += size;
+    seqAtomicStore64(&q->wr, q->wr + 1);
+    if (q->numBytes > q->highWater)
+        seqAtomicStore64(&q->highWater, q->numBytes);
+    epicsMutexUnlock(q->lock);
+    return lost;
+}
+
+static size_t ring_get(QUEUE q, seqQueueFunc *get, void *arg, size_t maxNum)
+{
+    size_t n;
+
+    epicsMutexMustLock(q->lock);
+    for (n = 0; n < maxNum && q->numRecs > 0; n++) {
+        ring_skip(q);
+        get(arg, recData(q, q->rdPos), recPtr(q, q->rdPos)->len);
+        ring_remove_first(q);
+    }
+    epicsMutexUnlock(q->lock);
+    return n;
+}
+
 epicsShareFunc boolean seqQueueInvariant(QUEUE q)
 {
     return (q != NULL)
         && q->elemSize > 0
         && q->numElems > 0
         && q->numElems <= seqQueueMaxNumElems
-        && q->rd < q->numElems
-        && q->wr < q->numElems;
+        && q->pow2 == ((q->numElems & (q->numElems - 1)) == 0)
+        && q->highWater <= q->numElems
+        && (q->lock
+            ? q->numBytes <= q->numElems
+                && q->rdPos <= q->numElems
+                && q->wrPos <= q->numElems
+                && (q->numRecs > 0 || q->numBytes == 0)
+            : q->rd <= q->wr
+                && q->wr - q->rd <= q->numElems);
 }
 
 epicsShareFunc QUEUE seqQueueCreate(size_t numElems, size_t elemSize)
+{
+    return seqQueueCreatePolicy(numElems, elemSize, seqQueueOverwriteLast);
+}
+
+epicsShareFunc QUEUE seqQueueCreatePolicy(size_t numElems, size_t elemSize,
+    enum seqQueuePolicy policy)
 {
     QUEUE q = new(struct seqQueue);
+    size_t i;
 
     if (!q) {
         errlogSevPrintf(errlogFatal, "seqQueueCreate: out of memory\n");
@@ -58,23 +284,79 @@ epicsShareFunc QUEUE seqQueueCreate(size_t numElems, size_t elemSize)
         free(q);
         return 0;
     }
-    q->mutex = epicsMutexCreate();
-    if (!q->mutex) {
+    q->seq = newArray(seqUInt64, numElems);
+    if (!q->seq) {
         errlogSevPrintf(errlogFatal, "seqQueueCreate: out of memory\n");
         free(q->buffer);
         free(q);
         return 0;
     }
+    for (i = 0; i < numElems; i++) {
+        q->seq[i] = 2 * (seqUInt64)i;
+    }
     q->elemSize = elemSize;
     q->numElems = numElems;
-    q->overflow = FALSE;
+    q->pow2 = (numElems & (numElems - 1)) == 0;
+    q->policy = policy;
     q->rd = q->wr = 0;
+    q->numDropped = q->highWater = 0;
+    seqAtomicBarrier();
+    return q;
+}
+
+epicsShareFunc QUEUE seqQueueCreateBytes(size_t numBytes, size_t maxElemSize,
+    enum seqQueuePolicy policy)
+{
+    QUEUE q = new(struct seqQueue);
+
+    if (!q) {
+        errlogSevPrintf(errlogFatal, "seqQueueCreateBytes: out of memory\n");
+        return 0;
+    }
+    /* check arguments to establish invariants */
+    if (maxElemSize == 0) {
+        errlogSevPrintf(errlogFatal, "seqQueueCreateBytes: maxElemSize must be positive\n");
+        free(q);
+        return 0;
+    }
+    if (numBytes > seqQueueMaxNumElems || maxElemSize > seqQueueMaxNumElems - REC_HDR) {
+        errlogSevPrintf(errlogFatal, "seqQueueCreateBytes: size too large\n");
+        free(q);
+        return 0;
+    }
+    numBytes -= numBytes % REC_HDR;
+    if (numBytes < recSize(maxElemSize)) {
+        errlogSevPrintf(errlogFatal, "seqQueueCreateBytes: numBytes must be at least %u\n",
+            (unsigned)recSize(maxElemSize));
+        free(q);
+        return 0;
+    }
+    q->buffer = (char *)calloc(numBytes, 1);
+    if (!q->buffer) {
+        errlogSevPrintf(errlogFatal, "seqQueueCreateBytes: out of memory\n");
+        free(q);
+        return 0;
+    }
+    q->lock = epicsMutexCreate();
+    if (!q->lock) {
+        errlogSevPrintf(errlogFatal, "seqQueueCreateBytes: epicsMutexCreate failed\n");
+        free(q->buffer);
+        free(q);
+        return 0;
+    }
+    q->elemSize = maxElemSize;
+    q->numElems = numBytes;
+    q->pow2 = (numBytes & (numBytes - 1)) == 0;
+    q->policy = policy;
+    ring_reset(q);
     return q;
 }
 
 epicsShareFunc void seqQueueDestroy(QUEUE q)
 {
-    epicsMutexDestroy(q->mutex);
+    if (q->lock)
+        epicsMutexDestroy(q->lock);
+    free(q->seq);
     free(q->buffer);
     free(q);
 }
@@ -86,23 +368,50 @@ epicsShareFunc boolean seqQueueGet(QUEUE q, void *value)
 
 epicsShareFunc boolean seqQueueGetF(QUEUE q, seqQueueFunc *get, void *arg)
 {
-    if (q->wr == q->rd) {
-        if (!q->overflow) {
-            return TRUE;
+    return seqQueueGetMany(q, get, arg, 1) == 0;
+}
+
+epicsShareFunc size_t seqQueueGetMany(QUEUE q, seqQueueFunc *get, void *arg,
+    size_t maxNum)
+{
+    unsigned spins = 0;
+
+    if (q->lock)
+        return ring_get(q, get, arg, maxNum);
+    while (maxNum > 0) {
+        seqUInt64 rd = seqAtomicLoad64(&q->rd);
+        seqUInt64 *cs = cellSeq(q, rd);
+        seqUInt64 seq = seqAtomicLoad64(cs);
+
+        if (seq == 2 * rd + 1) {
+            if (seqAtomicCas64(cs, seq, CELL_BUSY) == seq) {
+                size_t n, i;
+
+                get(arg, cellPtr(q, rd), q->elemSize);
+                /* while we hold the cell at rd no other get can proceed,
+                   so we may claim the filled cells following it, too */
+                for (n = 1; n < maxNum && n < q->numElems; n++) {
+                    cs = cellSeq(q, rd + n);
+                    seq = 2 * (rd + n) + 1;
+                    if (seqAtomicLoad64(cs) != seq
+                        || seqAtomicCas64(cs, seq, CELL_BUSY) != seq)
+                        break;
+                    get(arg, cellPtr(q, rd + n), q->elemSize);
+                }
+                seqAtomicStore64(&q->rd, rd + n);
+                for (i = 0; i < n; i++) {
+                    seqAtomicStore64(cellSeq(q, rd + i), 2 * (rd + i + q->numElems));
+                }
+                return n;
+            }
+        } else if (seq == 2 * rd) {
+            /* nothing put here yet, or a put is still in progress */
+            return 0;
         }
-        epicsMutexLock(q->mutex);
-        get(arg, q->buffer + q->rd * q->elemSize, q->elemSize);
-        /* check again, a put might have intervened */
-        if (q->wr == q->rd && q->overflow)
-            q->overflow = FALSE;
-        else
-            q->rd = (q->rd + 1) % q->numElems;
-        epicsMutexUnlock(q->mutex);
-    } else {
-        get(arg, q->buffer + q->rd * q->elemSize, q->elemSize);
-        q->rd = (q->rd + 1) % q->numElems;
+        /* another get or an overwriting put is busy with this cell */
+        seqAtomicBackoff(&spins);
     }
-    return FALSE;
+    return 0;
 }
 
 epicsShareFunc boolean seqQueuePut(QUEUE q, const void *value)
@@ -112,47 +421,86 @@ epicsShareFunc boolean seqQueuePut(QUEUE q, const void *value)
 
 epicsShareFunc boolean seqQueuePutF(QUEUE q, seqQueueFunc *put, const void *arg)
 {
-    boolean r = FALSE;
+    return seqQueuePutSizeF(q, put, arg, q->elemSize);
+}
+
+epicsShareFunc boolean seqQueuePutSizeF(QUEUE q, seqQueueFunc *put, const void *arg,
+    size_t size)
+{
+    unsigned spins = 0;
+    boolean lost = FALSE;
 
-    if (q->overflow || (q->wr + 1) % q->numElems == q->rd) {
-        epicsMutexLock(q->mutex);
-        if ((q->wr + 1) % q->numElems == q->rd) {
-            if (q->overflow) {
-                r = TRUE;   /* we will overwrite the last element */
+    if (size > q->elemSize) {
+        errlogSevPrintf(errlogMajor, "seqQueuePutSizeF: element too large\n");
+        return TRUE;
+    }
+    if (q->lock)
+        return ring_put(q, put, arg, size);
+    while (TRUE) {
+        seqUInt64 wr = seqAtomicLoad64(&q->wr);
+        seqUInt64 *cs = cellSeq(q, wr);
+        seqUInt64 seq = seqAtomicLoad64(cs);
+
+        if (seq == 2 * wr) {
+            if (seqAtomicCas64(&q->wr, wr, wr + 1) == wr) {
+                put(cellPtr(q, wr), arg, size);
+                seqAtomicStore64(cs, 2 * wr + 1);
+                update_high_water(q, wr);
+                return lost;
+            }
+            continue;   /* another put was faster, try next position */
+        } else if (wr >= q->numElems && seq == 2 * (wr - q->numElems) + 1) {
+            /* queue is full */
+            seqUInt64 last = wr - 1;
+            seqUInt64 *ls = cellSeq(q, last);
+
+            if (q->policy == seqQueueDropNewest) {
+                add64(&q->numDropped, 1);
+                return TRUE;
             }
-            q->overflow = TRUE;
-        } else if (q->overflow) {
-            /* we had a get since the last put, so
-               can now eliminate overflow flag and instead
-               increment the write pointer */
-            q->wr = (q->wr + 1) % q->numElems;
-            if ((q->wr + 1) % q->numElems != q->rd) {
-                q->overflow = FALSE;
+            if (q->policy == seqQueueDropOldest) {
+                /* make room, unless a get was faster */
+                if (seqQueueGetMany(q, discard, NULL, 1)) {
+                    add64(&q->numDropped, 1);
+                    lost = TRUE;
+                }
+                continue;
+            }
+            /* overwrite the last element */
+            if (seqAtomicCas64(ls, 2 * last + 1, CELL_BUSY) == 2 * last + 1) {
+                /* still full? (with one element we hold the only cell) */
+                if (q->numElems == 1 || seqAtomicLoad64(cs) == seq) {
+                    put(cellPtr(q, last), arg, size);
+                    seqAtomicStore64(ls, 2 * last + 1);
+                    add64(&q->numDropped, 1);
+                    return TRUE;
+                }
+                seqAtomicStore64(ls, 2 * last + 1);
             }
         }
-        put(q->buffer + q->wr * q->elemSize, arg, q->elemSize);
-        if (!q->overflow) {
-            q->wr = (q->wr + 1) % q->numElems;
-        }
-        epicsMutexUnlock(q->mutex);
-    } else {
-        put(q->buffer + q->wr * q->elemSize, arg, q->elemSize);
-        q->wr = (q->wr + 1) % q->numElems;
+        /* a get or another put is busy, retry */
+        seqAtomicBackoff(&spins);
     }
-    return r;
 }
 
 epicsShareFunc void seqQueueFlush(QUEUE q)
 {
-    epicsMutexLock(q->mutex);
-    q->rd = q->wr;
-    q->overflow = FALSE;
-    epicsMutexUnlock(q->mutex);
-}
+    size_t n;
 
-static size_t used(const QUEUE q)
-{
-    return (q->numElems + q->wr - q->rd) % q->numElems + (q->overflow ? 1 : 0);
+    if (q->lock) {
+        epicsMutexMustLock(q->lock);
+        ring_reset(q);
+        epicsMutexUnlock(q->lock);
+        return;
+    }
+    n = used(q);
+    /* remove (at most) the elements that are in the queue now */
+    while (n > 0) {
+        size_t got = seqQueueGetMany(q, discard, NULL, n);
+        if (got == 0)
+            break;
+        n -= got;
+    }
 }
 
 epicsShareFunc size_t seqQueueFree(const QUEUE q)
@@ -167,12 +515,20 @@ epicsShareFunc size_t seqQueueUsed(const QUEUE q)
 
 epicsShareFunc boolean seqQueueIsEmpty(const QUEUE q)
 {
-    return q->wr == q->rd && !q->overflow;
+    return used(q) == 0;
 }
 
 epicsShareFunc boolean seqQueueIsFull(const QUEUE q)
 {
-    return (q->wr + 1) % q->numElems == q->rd && q->overflow;
+    boolean full;
+
+    if (!q->lock)
+        return used(q) == q->numElems;
+    /* whether an element of maximum size might not fit */
+    epicsMutexMustLock(q->lock);
+    full = ring_place(q, recSize(q->elemSize)) == NOWHERE;
+    epicsMutexUnlock(q->lock);
+    return full;
 }
 
 epicsShareFunc size_t seqQueueNumElems(const QUEUE q)
@@ -184,3 +540,23 @@ epicsShareFunc size_t seqQueueElemSize(const QUEUE q)
 {
     return q->elemSize;
 }
+
+epicsShareFunc seqUInt64 seqQueueNumPut(const QUEUE q)
+{
+    seqUInt64 n = seqAtomicLoad64(&q->wr);
+
+    /* overwriting the last element is a put, too */
+    if (q->policy == seqQueueOverwriteLast && !q->lock)
+        n += seqAtomicLoad64(&q->numDropped);
+    return n;
+}
+
+epicsShareFunc seqUInt64 seqQueueNumDropped(const QUEUE q)
+{
+    return seqAtomicLoad64(&q->numDropped);
+}
+
+epicsShareFunc size_t seqQueueHighWater(const QUEUE q)
+{
+    return (size_t)seqAtomicLoad64(&q->highWater);
+}
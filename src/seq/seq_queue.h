@@ -7,12 +7,14 @@ in the file LICENSE that is included with this distribution.
 /*************************************************************************\
 This module implements fifo queues, similar to and inspired by
 epicsRingBytes, but with a fixed element size and such that a put
-overwrites the last element if the queue is full. Put and get
-operations always work on a single element.
-
-The implementation allows one reader and one writer to access the queue
-without taking a mutex, except where unavoidable, i.e. when the queue is
-full.
+overwrites the last element if the queue is full (other policies can
+be selected on creation). Put operations always work on a single
+element, get operations may remove several elements at once.
+
+The implementation is lock-free and allows any number of readers and
+writers to access the queue concurrently. Read and write positions are
+monotonic 64 bit counters, and each element has its own sequence number
+that tells whether it is empty, filled, or being accessed.
 \*************************************************************************/
 #ifndef INCLseq_queueh
 #define INCLseq_queueh
@@ -22,9 +24,17 @@ typedef struct seqQueue *QUEUE;
 /* to avoid overflow when calculating next put/get positions */
 #define seqQueueMaxNumElems (((size_t)-1)>>1)
 
+/* What a put does if the queue is full */
+enum seqQueuePolicy {
+    seqQueueOverwriteLast,  /* overwrite the last (youngest) element */
+    seqQueueDropOldest,     /* remove the first (oldest) element */
+    seqQueueDropNewest      /* discard the new element */
+};
+
 /* Create a new queue with the given element size and
    number of elements and return it, if successful,
-   otherwise return NULL.
+   otherwise return NULL. Queues with a power of two
+   number of elements are (a bit) faster.
    Restrictions:
       numElems > 0
       numElems <= seqQueueMaxNumElems
@@ -32,6 +42,24 @@ typedef struct seqQueue *QUEUE;
 */
 epicsShareFunc QUEUE seqQueueCreate(size_t numElems, size_t elemSize);
 
+/* Like seqQueueCreate, but with the given overflow policy.
+   seqQueueCreate(n,s) == seqQueueCreatePolicy(n,s,seqQueueOverwriteLast) */
+epicsShareFunc QUEUE seqQueueCreatePolicy(size_t numElems, size_t elemSize,
+    enum seqQueuePolicy policy);
+
+/* Create a byte queue: elements may have any size up to
+   maxElemSize and are stored in a buffer of numBytes bytes,
+   so that memory usage depends on the actual element sizes.
+   For byte queues, seqQueueNumElems, seqQueueUsed, seqQueueFree,
+   and seqQueueHighWater count bytes instead of elements, and
+   seqQueueIsFull means an element of maximum size might not fit.
+   Restrictions:
+      maxElemSize > 0
+      numBytes large enough for one element of maximum size
+*/
+epicsShareFunc QUEUE seqQueueCreateBytes(size_t numBytes, size_t maxElemSize,
+    enum seqQueuePolicy policy);
+
 /* Return whether all invariants are satisfied */
 epicsShareFunc boolean seqQueueInvariant(QUEUE q);
 
@@ -45,7 +73,7 @@ epicsShareFunc boolean seqQueueInvariant(QUEUE q);
 
    Note that seqQueueGet returns FALSE on success and
    that seqQueuePut returns FALSE if no element was
-   overwritten. */
+   lost. */
 
 /* Destroy the queue, freeing all memory. */
 epicsShareFunc void seqQueueDestroy(QUEUE q);
@@ -58,10 +86,10 @@ epicsShareFunc void seqQueueDestroy(QUEUE q);
 epicsShareFunc boolean seqQueueGet(QUEUE q, void *value);
 
 /* Put an element into the queue. Return whether the
-   queue was full and therefore its last element was
-   overwritten. The value argument must point to a
-   memory area with at least seqQueueElemSize(q)
-   bytes. */
+   queue was full and therefore an element was lost,
+   according to the queue's policy. The value argument
+   must point to a memory area with at least
+   seqQueueElemSize(q) bytes. */
 epicsShareFunc boolean seqQueuePut(QUEUE q, const void *value);
 
 /* Remove all elements. Cheap. */
@@ -85,6 +113,14 @@ epicsShareFunc boolean seqQueueIsEmpty(const QUEUE q);
 /* Whether full, same as seqQueueFree(q)==0 */
 epicsShareFunc boolean seqQueueIsFull(const QUEUE q);
 
+/* Statistics, maintained without locking: the number of
+   elements ever put into the queue, the number of elements
+   lost because the queue was full, and the maximum number
+   of elements that were in use at the same time. */
+epicsShareFunc seqUInt64 seqQueueNumPut(const QUEUE q);
+epicsShareFunc seqUInt64 seqQueueNumDropped(const QUEUE q);
+epicsShareFunc size_t seqQueueHighWater(const QUEUE q);
+
 
 /* Unsafe operations; use with care */
 typedef void* seqQueueFunc(void *dest, const void *src, size_t elemSize);
@@ -95,9 +131,22 @@ typedef void* seqQueueFunc(void *dest, const void *src, size_t elemSize);
    */
 epicsShareFunc boolean seqQueueGetF(QUEUE q, seqQueueFunc *f, void *arg);
 
+/* Like seqQueueGetF but removes up to maxNum elements at once,
+   calling the function for each of them in order. Returns the
+   number of elements removed, which is 0 if the queue is empty.
+   seqQueueGetF(q,f,v) == (seqQueueGetMany(q,f,v,1) == 0) */
+epicsShareFunc size_t seqQueueGetMany(QUEUE q, seqQueueFunc *f, void *arg, size_t maxNum);
+
 /* Like seqQueuePut but does not copy the element's data;
    instead the user supplied function is called.
    seqQueuePut(q,v) == seqQueuePutF(q,memcpy,v) */
 epicsShareFunc boolean seqQueuePutF(QUEUE q, seqQueueFunc *f, const void *arg);
 
+/* Like seqQueuePutF for an element of the given size, which must
+   not exceed seqQueueElemSize(q). Byte queues store only size
+   bytes; the get functions pass the element's size to f.
+   seqQueuePutF(q,f,v) == seqQueuePutSizeF(q,f,v,seqQueueElemSize(q)) */
+epicsShareFunc boolean seqQueuePutSizeF(QUEUE q, seqQueueFunc *f, const void *arg,
+    size_t size);
+
 #endif /* INCLseq_queueh */
@@ -43,6 +43,9 @@ extern "C" {
 #define OPT_REENT		((seqMask)1u<<3)	/* generate reentrant code */
 #define OPT_NEWEF		((seqMask)1u<<4)	/* new event flag mode */
 #define OPT_SAFE		((seqMask)1u<<5)	/* safe mode */
+#define OPT_LOCKFREE		((seqMask)1u<<6)	/* lock-free shared buffers */
+#define OPT_BATCH		((seqMask)1u<<7)	/* batch monitor events */
+#define OPT_COOP		((seqMask)1u<<8)	/* run all state sets in one thread */
 
 /* Bit encoding for state specific options */
 #define OPT_NORESETTIMERS	((seqMask)1u<<0)	/* Don't reset timers on */
@@ -68,6 +71,16 @@ typedef void SEQ_PROG_FUNC(PROG_ID progId);
 typedef const struct seqChan seqChan;
 typedef const struct seqState seqState;
 typedef const struct seqSS seqSS;
+typedef const struct seqVarField seqVarField;
+
+/* What to do if a syncQ queue is full */
+enum syncqPolicy {
+	SYNCQ_OVERWRITE_LAST,		/* overwrite youngest element (default) */
+	SYNCQ_DROP_OLDEST,		/* remove oldest element */
+	SYNCQ_DROP_NEWEST,		/* discard new element */
+	SYNCQ_BLOCK			/* like SYNCQ_DROP_NEWEST, but pvPut
+					   waits (up to its timeout) for space */
+};
 
 /* Static information about a channel */
 struct seqChan
@@ -82,6 +95,10 @@ struct seqChan
 	seqBool		monitored;	/* whether channel should be monitored */
 	unsigned	queueSize;	/* syncQ queue size (0=not queued) */
 	unsigned	queueIndex;	/* syncQ queue index */
+	enum syncqPolicy queuePolicy;	/* syncQ overflow policy */
+	seqBool		queueBytes;	/* whether queueSize is in bytes */
+	unsigned	queueWatermark;	/* syncQ wakeup watermark (0=none) */
+	double		queueTimeout;	/* syncQ wakeup timeout (0=none) */
 };
 
 /* Static information about a state */
@@ -94,6 +111,18 @@ struct seqState
 	SEQ_SS_FUNC	*exitFunc;	/* statements performed on exit from state */
 	const seqMask	*eventMask;	/* event mask for this state */
 	seqMask		options;	/* state option mask */
+	const seqMask	*transMask;	/* event masks for each transition
+					   (or 0) */
+	const seqMask	*readMask;	/* channels to read in safe mode
+					   (or 0 for all) */
+};
+
+/* A variable in the local copy of a state set (safe mode) */
+struct seqVarField
+{
+	size_t		offset;		/* offset in user variable area */
+	size_t		localOffset;	/* offset in local copy */
+	size_t		size;		/* # bytes */
 };
 
 /* Static information about a state set */
@@ -102,6 +131,10 @@ struct seqSS
 	const char	*ssName;	/* state set name */
 	seqState	*states;	/* array of state blocks */
 	unsigned	numStates;	/* number of states in this state set */
+	seqVarField	*varFields;	/* variables in local copy (safe mode) */
+	unsigned	numVarFields;	/* number of varFields */
+	unsigned	varSize;	/* # bytes in local copy, or 0 if it
+					   holds the whole user variable area */
 };
 
 /* Static information about a state program */
@@ -125,6 +158,9 @@ struct seqProgram
 
 epicsShareFunc void seq_efInit(PROG_ID sp, EF_ID ev_flag, unsigned val);
 
+/* called by generated event functions */
+epicsShareFunc seqBool seq_transChanged(SS_ID ss, int transNum);
+
 /* called by generated main and registrar routines */
 epicsShareFunc void seqRegisterSequencerProgram(seqProgram *p);
 epicsShareFunc void seqRegisterSequencerCommands(void);
@@ -141,10 +177,13 @@ epicsShareFunc seqBool seq_pvArrayPutComplete(SS_ID, CH_ID,
 	unsigned, seqBool, seqBool*);
 epicsShareFunc void seq_pvArrayGetCancel(SS_ID, CH_ID, unsigned);
 epicsShareFunc void seq_pvArrayPutCancel(SS_ID, CH_ID, unsigned);
+epicsShareFunc pvStat seq_pvArrayGet(SS_ID, CH_ID, unsigned, enum compType, double);
+epicsShareFunc pvStat seq_pvArrayPut(SS_ID, CH_ID, unsigned, enum compType, double);
 epicsShareFunc pvStat seq_pvArrayMonitor(SS_ID, CH_ID, unsigned);
 epicsShareFunc pvStat seq_pvArrayStopMonitor(SS_ID, CH_ID, unsigned);
 epicsShareFunc void seq_pvArraySync(SS_ID, CH_ID, unsigned, EF_ID);
 epicsShareFunc seqBool seq_pvArrayConnected(SS_ID ss, CH_ID chId, unsigned length);
+epicsShareFunc unsigned seq_pvGetQMany(SS_ID, CH_ID, void *, unsigned);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -14,6 +14,8 @@ in the file LICENSE that is included with this distribution.
 #include "seq_debug.h"
 
 static void ss_entry(void *arg);
+static void ss_read_all_buffer(PROG *sp, SSCB *ss, const seqMask *mask);
+static void ss_coop_entry(PROG *sp);
 
 /*
  * sequencer() - Sequencer main thread entry point.
@@ -43,13 +45,27 @@ void sequencer (void *arg)	/* ptr to original (global) state program table */
 	sp->initFunc(sp);
 
 	/* Initialize state set variables. In safe mode, copy variable
-	   block to state set buffers. Must do all this before connecting. */
+	   block (or the variables the state set uses) to state set
+	   buffers. Must do all this before connecting. */
 	if (optTest(sp, OPT_SAFE))
 	{
 		for (nss = 0; nss < sp->numSS; nss++)
 		{
 			SSCB	*ss = sp->ss + nss;
-			memcpy(ss->var, sp->var, sp->varSize);
+			unsigned nf;
+
+			if (!ss->varSubset)
+			{
+				memcpy(ss->var, sp->var, ss->varSize);
+				continue;
+			}
+			for (nf = 0; nf < ss->numVarFields; nf++)
+			{
+				seqVarField *vf = ss->varFields + nf;
+
+				memcpy((char *)ss->var + vf->localOffset,
+					(char *)sp->var + vf->offset, vf->size);
+			}
 		}
 	}
 
@@ -74,6 +90,26 @@ void sequencer (void *arg)	/* ptr to original (global) state program table */
 	   Treat as if called from 1st state set. */
 	if (sp->entryFunc) sp->entryFunc(sp->ss);
 
+	/* With option +T, this thread runs all state sets */
+	if (optTest(sp, OPT_COOP))
+	{
+		ss_coop_entry(sp);
+		goto done;
+	}
+
+	/* With the pool parameter, the worker pool runs all state sets,
+	   and this thread only waits for them to exit. Its thread id
+	   identifies the program, e.g. for seqShow. */
+	if (sp->pooled)
+	{
+		for (nss = 1; nss < sp->numSS; nss++)
+			sp->ss[nss].threadId = sp->ss->threadId;
+		seqPoolStart(sp);
+		for (nss = 0; nss < sp->numSS; nss++)
+			epicsEventMustWait(sp->ss[nss].dead);
+		goto done;
+	}
+
 	/* Create each additional state set task (additional state set thread
 	   names are derived from the first ss) */
 	epicsThreadGetName(sp->ss->threadId, threadName, sizeof(threadName));
@@ -107,9 +143,16 @@ void sequencer (void *arg)	/* ptr to original (global) state program table */
 		epicsEventMustWait(ss->dead);
 	}
 
+done:
 	/* Call program exit function if defined.
-	   Treat as if called from 1st state set. */
-	if (sp->exitFunc) sp->exitFunc(sp->ss);
+	   Treat as if called from 1st state set,
+	   which may not have read all channels. */
+	if (sp->exitFunc)
+	{
+		if (optTest(sp, OPT_SAFE))
+			ss_read_all_buffer(sp, sp->ss, NULL);
+		sp->exitFunc(sp->ss);
+	}
 
 exit:
 	DEBUG("   Disconnect all channels\n");
@@ -125,13 +168,41 @@ exit:
 	seq_free(sp);
 }
 
+/*
+ * With option +L, the shared buffer of a channel is protected by a
+ * sequence lock instead of a mutex: a writer makes the sequence number
+ * odd while it writes and even again when done, and a reader copies
+ * optimistically, retrying if the sequence number was odd or changed
+ * while it was copying. Writers exclude each other via the odd sequence
+ * number but never wait for readers.
+ */
+static epicsUInt32 buf_write_begin(CHAN *ch)
+{
+	unsigned spins = 0;
+
+	while (TRUE)
+	{
+		epicsUInt32 seq = ch->bufSeq;
+
+		if (!(seq & 1u) && seqAtomicCas(&ch->bufSeq, seq, seq + 1) == seq)
+			return seq + 1;
+		seqAtomicBackoff(&spins);
+	}
+}
+
+static void buf_write_end(CHAN *ch, epicsUInt32 seq)
+{
+	seqAtomicBarrier();
+	ch->bufSeq = seq + 1;
+}
+
 /*
  * ss_read_buffer_static() - static version of ss_read_buffer.
  * This is to enable inlining in the for loop in ss_read_all_buffer.
  */
 static void ss_read_buffer_static(SSCB *ss, CHAN *ch, boolean dirty_only)
 {
-	char *val = valPtr(ch,ss);
+	char *val;
 	char *buf = bufPtr(ch);
 	ptrdiff_t nch = chNum(ch);
 	/* Must take dbCount for db channels, else we overwrite
@@ -139,8 +210,47 @@ static void ss_read_buffer_static(SSCB *ss, CHAN *ch, boolean dirty_only)
 	size_t count = ch->dbch ? ch->dbch->dbCount : ch->count;
 	size_t var_size = ch->type->size * count;
 
-	if (!ss->dirty[nch] && dirty_only)
+	if (dirty_only && !bitTest(ss->dirty, nch))
+		return;
+
+	/* not in the state set's local copy */
+	if (!hasVal(ch, ss))
+	{
+		bitClearAtomic(ss->dirty, nch);
+		return;
+	}
+	val = valPtr(ch,ss);
+
+	if (optTest(ss->prog, OPT_LOCKFREE))
+	{
+		unsigned spins = 0;
+
+		/* Clear the dirty flag before reading, so that a write
+		   that completes after we are done sets it again. */
+		bitClearAtomic(ss->dirty, nch);
+		while (TRUE)
+		{
+			epicsUInt32 seq = ch->bufSeq;
+
+			if (!(seq & 1u))
+			{
+				seqAtomicBarrier();
+				memcpy(val, buf, var_size);
+				if (ch->dbch)
+				{
+					/* structure copy */
+					ss->metaData[nch] = ch->dbch->metaData;
+				}
+				seqAtomicBarrier();
+				if (ch->bufSeq == seq)
+					break;
+			}
+			seqAtomicBackoff(&spins);
+		}
+		DEBUG("ss %s: after read %s", ss->ssName, ch->varName);
+		print_channel_value(DEBUG, ch, val);
 		return;
+	}
 
 	epicsMutexMustLock(ch->varLock);
 
@@ -157,7 +267,7 @@ static void ss_read_buffer_static(SSCB *ss, CHAN *ch, boolean dirty_only)
 	DEBUG("ss %s: after read %s", ss->ssName, ch->varName);
 	print_channel_value(DEBUG, ch, val);
 
-	ss->dirty[nch] = FALSE;
+	bitClearAtomic(ss->dirty, nch);
 
 	epicsMutexUnlock(ch->varLock);
 }
@@ -173,45 +283,84 @@ void ss_read_buffer(SSCB *ss, CHAN *ch, boolean dirty_only)
 	ss_read_buffer_static(ss, ch, dirty_only);
 }
 
+/*
+ * seqMaskFirstSet() - Portable fallback for bitFirstSet.
+ */
+unsigned seqMaskFirstSet(bitMask word)
+{
+	unsigned n = 0;
+
+	assert(word != 0);
+	while (!(word & 1u))
+	{
+		word >>= 1;
+		n++;
+	}
+	return n;
+}
+
 /*
  * ss_read_all_buffer() - Call ss_read_buffer_static
- * for all channels.
+ * for all dirty channels in mask (or all dirty channels
+ * if mask is NULL). Scans the dirty bitmap word by word,
+ * so clean channels cost (almost) nothing. Channels not
+ * in the mask stay dirty until a state that uses them
+ * gets evaluated.
  */
-static void ss_read_all_buffer(PROG *sp, SSCB *ss)
+static void ss_read_all_buffer(PROG *sp, SSCB *ss, const seqMask *mask)
 {
-	unsigned nch;
+	unsigned nw;
 
-	for (nch = 0; nch < sp->numChans; nch++)
+	for (nw = 0; nw * NBITS < sp->numChans; nw++)
 	{
-		CHAN *ch = sp->chan + nch;
-		/* Call static version so it gets inlined */
-		ss_read_buffer_static(ss, ch, TRUE);
+		bitMask dirty = ss->dirty[nw];
+
+		if (mask)
+			dirty &= mask[nw];
+
+		while (dirty)
+		{
+			CHAN *ch = sp->chan + nw * NBITS + bitFirstSet(dirty);
+			/* Call static version so it gets inlined */
+			ss_read_buffer_static(ss, ch, TRUE);
+			dirty &= dirty - 1;	/* clear lowest bit */
+		}
 	}
 }
 
 /*
  * ss_read_all_buffer_selective() - Call ss_read_buffer_static
- * for all channels that are sync'ed to the given event flag.
- * NOTE: calling code must take sp->lock, as we traverse
- * the list of channels synced to this event flag.
+ * for all dirty channels that are sync'ed to the given event flag.
+ * Needs no lock: the mask of synced channels is only ever changed
+ * one bit at a time, using atomic operations.
  */
 void ss_read_buffer_selective(PROG *sp, SSCB *ss, EF_ID ev_flag)
 {
-	CHAN *ch = sp->syncedChans[ev_flag];
-	while (ch)
+	const bitMask *synced = syncedMask(sp, ev_flag);
+	unsigned nw;
+
+	for (nw = 0; nw * NBITS < sp->numChans; nw++)
 	{
-		/* Call static version so it gets inlined */
-		ss_read_buffer_static(ss, ch, TRUE);
-		ch = ch->nextSynced;
+		bitMask todo = synced[nw] & ss->dirty[nw];
+
+		while (todo)
+		{
+			CHAN *ch = sp->chan + nw * NBITS + bitFirstSet(todo);
+			/* Call static version so it gets inlined */
+			ss_read_buffer_static(ss, ch, TRUE);
+			todo &= todo - 1;	/* clear lowest bit */
+		}
 	}
 }
 
 /*
  * ss_write_buffer() - Copy given value and meta data
  * to shared buffer. In safe mode, if dirtify is TRUE then
- * set dirty flag for each state set.
+ * set dirty flag for each state set that holds the variable.
+ * Return whether the dirty flag was already set for all of
+ * them, i.e. the previous value has not yet been read by any.
  */
-void ss_write_buffer(CHAN *ch, void *val, PVMETA *meta, boolean dirtify)
+boolean ss_write_buffer(CHAN *ch, void *val, PVMETA *meta, boolean dirtify)
 {
 	PROG *sp = ch->prog;
 	char *buf = bufPtr(ch);		/* shared buffer */
@@ -221,8 +370,13 @@ void ss_write_buffer(CHAN *ch, void *val, PVMETA *meta, boolean dirtify)
 	size_t var_size = ch->type->size * count;
 	ptrdiff_t nch = chNum(ch);
 	unsigned nss;
+	epicsUInt32 seq = 0;
+	boolean unread = FALSE;
 
-	epicsMutexMustLock(ch->varLock);
+	if (optTest(sp, OPT_LOCKFREE))
+		seq = buf_write_begin(ch);
+	else
+		epicsMutexMustLock(ch->varLock);
 
 	DEBUG("ss_write_buffer: before write %s", ch->varName);
 	print_channel_value(DEBUG, ch, buf);
@@ -236,143 +390,319 @@ void ss_write_buffer(CHAN *ch, void *val, PVMETA *meta, boolean dirtify)
 	print_channel_value(DEBUG, ch, buf);
 
 	if (optTest(sp, OPT_SAFE) && dirtify)
+	{
+		bitMask bit = 1u << (nch % NBITS);
+		boolean held = FALSE;
+
+		unread = TRUE;
 		for (nss = 0; nss < sp->numSS; nss++)
-			sp->ss[nss].dirty[nch] = TRUE;
+		{
+			SSCB *ss = sp->ss + nss;
+
+			/* A state set whose local copy does not hold the
+			   variable never reads it, so it need not be marked */
+			if (!hasVal(ch, ss))
+				continue;
+			held = TRUE;
+			if (!(bitSetAtomic(ss->dirty, nch) & bit))
+				unread = FALSE;
+		}
+		unread = unread && held;
+	}
 
-	epicsMutexUnlock(ch->varLock);
+	if (optTest(sp, OPT_LOCKFREE))
+		buf_write_end(ch, seq);
+	else
+		epicsMutexUnlock(ch->varLock);
+	return unread;
 }
 
 /*
- * ss_entry() - Thread entry point for all state sets.
- * Provides the main loop for state set processing.
+ * ss_take_pending() - Atomically reset the set of pending events, add
+ * them to the set of changed events, and return whether any of them is
+ * relevant for the current state, i.e. is in the state's event mask.
+ * Bit zero, which is not used in event masks, requests unconditional
+ * re-evaluation.
  */
-static void ss_entry(void *arg)
+static boolean ss_take_pending(PROG *sp, SSCB *ss)
 {
-	SSCB		*ss = (SSCB *)arg;
-	PROG		*sp = ss->prog;
+	unsigned i, nwords = NWORDS(sp->numEvFlags + sp->numChans);
+	boolean relevant = FALSE;
 
-	/* Attach to PV system; was already done for the first state set */
-	if (ss != sp->ss)
+	for (i = 0; i < nwords; i++)
 	{
-		ss->threadId = epicsThreadGetIdSelf();
-		createOrAttachPvSystem(sp);
+		if (ss->pending[i])
+		{
+			bitMask events = seqAtomicAnd(ss->pending + i, 0);
+
+			ss->changed[i] |= events;
+			if ((events & ss->mask[i]) || (i == 0 && (events & 1u)))
+				relevant = TRUE;
+		}
 	}
+	return relevant;
+}
 
-	/* Register this thread with the EPICS watchdog (no callback func) */
-	taskwdInsert(ss->threadId, 0, 0);
+/*
+ * seq_transChanged() - Return whether any event in the mask of
+ * transition transNum of the current state has occurred since the
+ * conditions were last evaluated. The code generator calls this
+ * before evaluating a condition that depends on nothing but these
+ * events: if none occurred, the condition is still false, because
+ * otherwise we would have left the state.
+ */
+epicsShareFunc boolean seq_transChanged(SS_ID ss, int transNum)
+{
+	PROG	*sp = ss->prog;
+	unsigned i, nwords = NWORDS(sp->numEvFlags + sp->numChans);
+	const bitMask *mask = ss->states[ss->currentState].transMask;
+
+	if (!mask)
+		return TRUE;
+	mask += transNum * nwords;
+	for (i = 0; i < nwords; i++)
+	{
+		if (ss->changed[i] & mask[i])
+			return TRUE;
+	}
+	return FALSE;
+}
 
+/*
+ * ss_set_timer() - (Re-)start or cancel the wakeup timer according to
+ * the earliest unexpired delay found during the last evaluation of the
+ * when() conditions. If the timer has expired in the meantime, start it
+ * again even if the delay has not changed, as the delay did not yet
+ * appear to be expired when we checked.
+ */
+static void ss_set_timer(SSCB *ss)
+{
+	/* The callback only reports expiry, so that nothing else writes
+	   timerArmed. A late report for a timer we have restarted since
+	   merely makes us restart it once more. */
+	if (seqAtomicAnd(&ss->timerExpired, 0u))
+		ss->timerArmed = FALSE;
+	if (ss->wakeupTime < epicsINF)
+	{
+		if (!ss->timerArmed || ss->wakeupTime != ss->timerTime)
+		{
+			assert(ss->evalTime > 0.0);
+			ss->timerTime = ss->wakeupTime;
+			ss->timerArmed = TRUE;
+			epicsTimerStartDelay(ss->wakeupTimer,
+				max(ss->wakeupTime - ss->evalTime, 0.0));
+		}
+	}
+	else if (ss->timerArmed)
+	{
+		epicsTimerCancel(ss->wakeupTimer);
+		ss->timerArmed = FALSE;
+	}
+}
+
+/*
+ * ss_timer_expired() - Wakeup timer callback, called from the
+ * shared timer queue's thread.
+ */
+void ss_timer_expired(void *arg)
+{
+	SSCB *ss = (SSCB *)arg;
+
+	seqAtomicOr(&ss->timerExpired, 1u);
+	ss_signal(ss);
+}
+
+/*
+ * ss_init() - Prepare a state set for running its first state.
+ */
+static void ss_init(PROG *sp, SSCB *ss)
+{
 	/* In safe mode, update local var buffer with global one before
 	   entering the event loop. Must do this using
 	   ss_read_all_buffer since CA and other state sets could
 	   already post events resp. pvPut. */
 	if (optTest(sp, OPT_SAFE))
-		ss_read_all_buffer(sp, ss);
+		ss_read_all_buffer(sp, ss, NULL);
 
 	/* Initial state is the first one */
 	ss->currentState = 0;
 	ss->nextState = -1;
 	ss->prevState = -1;
+}
 
-	DEBUG("ss %s: entering main loop\n", ss->ssName);
+/*
+ * ss_enter_state() - Enter the current state of a state set.
+ */
+static void ss_enter_state(PROG *sp, SSCB *ss)
+{
+	STATE	*st = ss->states + ss->currentState;
+	double	now;
 
-	/*
-	 * ============= Main loop ==============
+	/* Set state to current state */
+	assert(ss->currentState >= 0);
+
+	/* Set state set event mask to this state's event mask and
+	 * make it visible to ss_wakeup before we look at any data.
 	 */
-	while (TRUE)
+	ss->mask = st->eventMask;
+	seqAtomicBarrier();
+
+	/* If we've changed state, do any entry actions. Also do these
+	 * even if it's the same state if option to do so is enabled.
+	 */
+	if (st->entryFunc && (ss->prevState != ss->currentState
+		|| optTest(st, OPT_DOENTRYFROMSELF)))
 	{
-		boolean	ev_trig;
-		int	transNum = 0;	/* highest prio trans. # triggered */
-		STATE	*st = ss->states + ss->currentState;
-		double	now;
+		st->entryFunc(ss);
+	}
 
-		/* Set state to current state */
-		assert(ss->currentState >= 0);
+	/* Flush any outstanding DB requests */
+	pvSysFlush(sp->pvSys);
 
-		/* Set state set event mask to this state's event mask */
-		ss->mask = st->eventMask;
+	/* Setting this pending bit here guarantees that a when() is
+	 * always executed at least once when a state is first entered.
+	 * Marking all events as changed does the same for conditions
+	 * that are only evaluated after one of their events.
+	 */
+	seqAtomicOr(ss->pending, 1u);
+	memset(ss->changed, 0xff,
+		NWORDS(sp->numEvFlags + sp->numChans) * sizeof(bitMask));
 
-		/* If we've changed state, do any entry actions. Also do these
-		 * even if it's the same state if option to do so is enabled.
-		 */
-		if (st->entryFunc && (ss->prevState != ss->currentState
-			|| optTest(st, OPT_DOENTRYFROMSELF)))
-		{
-			st->entryFunc(ss);
-		}
+	pvTimeGetCurrentDouble(&now);
+
+	/* Set time we entered this state if transition from a different
+	 * state or else if option not to do so is off for this state.
+	 */
+	if ((ss->currentState != ss->prevState) ||
+		!optTest(st, OPT_NORESETTIMERS))
+	{
+		ss->timeEntered = now;
+	}
+	ss->wakeupTime = epicsINF;
+}
 
-		/* Flush any outstanding DB requests */
-		pvSysFlush(sp->pvSys);
+/*
+ * ss_transition() - If a relevant event is pending, evaluate the when()
+ * conditions of the current state, and if one of them is true, do the
+ * transition. Return whether a transition was done; the caller must
+ * then enter the new state, unless we have been asked to exit.
+ */
+static boolean ss_transition(PROG *sp, SSCB *ss)
+{
+	boolean	ev_trig;
+	int	transNum = 0;	/* highest prio trans. # triggered */
+	STATE	*st = ss->states + ss->currentState;
+
+	/* Wake up on relevant PV event, event flag, or expired
+	 * delay; other events do not change the outcome of the
+	 * when() conditions, so there is no need to check them.
+	 * Delays are handled by the wakeup timer, which marks
+	 * an unconditional event when it expires.
+	 */
+	if (!ss_take_pending(sp, ss))
+		return FALSE;
 
-		/* Setting this semaphore here guarantees that a when() is
-		 * always executed at least once when a state is first entered.
-		 */
-		epicsEventSignal(ss->syncSem);
+	/* Check whether we have been asked to exit */
+	if (sp->die)
+		return FALSE;
 
-		pvTimeGetCurrentDouble(&now);
+	/* Copy dirty variable values from CA buffer
+	 * to user (safe mode only), but only those
+	 * the current state uses.
+	 */
+	if (optTest(sp, OPT_SAFE))
+		ss_read_all_buffer(sp, ss, st->readMask);
 
-		/* Set time we entered this state if transition from a different
-		 * state or else if option not to do so is off for this state.
-		 */
-		if ((ss->currentState != ss->prevState) ||
-			!optTest(st, OPT_NORESETTIMERS))
+	ss->wakeupTime = epicsINF;
+	ss->evalTime = 0.0;	/* read clock lazily in delay() */
+
+	/* Check state change conditions */
+	ev_trig = st->eventFunc(ss,
+		&transNum, &ss->nextState);
+
+	/* Clear all event flags (old ef mode only) */
+	if (ev_trig && !optTest(sp, OPT_NEWEF))
+	{
+		unsigned i;
+		for (i = 0; i < NWORDS(sp->numEvFlags); i++)
 		{
-			ss->timeEntered = now;
+			seqAtomicAnd(sp->evFlags + i, ~ss->mask[i]);
 		}
-		ss->wakeupTime = epicsINF;
+	}
+	if (!ev_trig)
+	{
+		ss_set_timer(ss);
+		memset(ss->changed, 0,
+			NWORDS(sp->numEvFlags + sp->numChans) * sizeof(bitMask));
+	}
+	ss->evalTime = 0.0;
+	if (!ev_trig)
+		return FALSE;
 
-		/* Loop until an event is triggered, i.e. when() returns TRUE
-		 */
-		do {
-			/* Wake up on PV event, event flag, or expired delay */
-			DEBUG("before epicsEventWaitWithTimeout(ss=%d,timeout=%f)\n",
-				ss - sp->ss, ss->wakeupTime - now);
-			epicsEventWaitWithTimeout(ss->syncSem, ss->wakeupTime - now);
-			DEBUG("after epicsEventWaitWithTimeout()\n");
+	/* Execute the state change action */
+	st->actionFunc(ss, transNum, &ss->nextState);
 
-			/* Check whether we have been asked to exit */
-			if (sp->die) goto exit;
+	/* Check whether we have been asked to exit */
+	if (sp->die)
+		return TRUE;
+
+	/* If changing state, do exit actions */
+	if (st->exitFunc && (ss->currentState != ss->nextState
+		|| optTest(st, OPT_DOEXITTOSELF)))
+	{
+		st->exitFunc(ss);
+	}
 
-			/* Copy dirty variable values from CA buffer
-			 * to user (safe mode only).
-			 */
-			if (optTest(sp, OPT_SAFE))
-				ss_read_all_buffer(sp, ss);
+	/* Change to next state */
+	ss->prevState = ss->currentState;
+	ss->currentState = ss->nextState;
+	return TRUE;
+}
+
+/*
+ * ss_entry() - Thread entry point for all state sets.
+ * Provides the main loop for state set processing.
+ */
+static void ss_entry(void *arg)
+{
+	SSCB		*ss = (SSCB *)arg;
+	PROG		*sp = ss->prog;
 
-			ss->wakeupTime = epicsINF;
+	/* Attach to PV system; was already done for the first state set */
+	if (ss != sp->ss)
+	{
+		ss->threadId = epicsThreadGetIdSelf();
+		createOrAttachPvSystem(sp);
+	}
 
-			/* Check state change conditions */
-			ev_trig = st->eventFunc(ss,
-				&transNum, &ss->nextState);
+	/* Register this thread with the EPICS watchdog (no callback func) */
+	taskwdInsert(ss->threadId, 0, 0);
 
-			/* Clear all event flags (old ef mode only) */
-			if (ev_trig && !optTest(sp, OPT_NEWEF))
-			{
-				unsigned i;
-				for (i = 0; i < NWORDS(sp->numEvFlags); i++)
-				{
-					sp->evFlags[i] &= ~ss->mask[i];
-				}
-			}
-			if (!ev_trig)
-				pvTimeGetCurrentDouble(&now);
-		} while (!ev_trig);
+	ss_init(sp, ss);
 
-		/* Execute the state change action */
-		st->actionFunc(ss, transNum, &ss->nextState);
+	DEBUG("ss %s: entering main loop\n", ss->ssName);
 
-		/* Check whether we have been asked to exit */
-		if (sp->die) goto exit;
+	/*
+	 * ============= Main loop ==============
+	 */
+	while (TRUE)
+	{
+		ss_enter_state(sp, ss);
 
-		/* If changing state, do exit actions */
-		if (st->exitFunc && (ss->currentState != ss->nextState
-			|| optTest(st, OPT_DOEXITTOSELF)))
+		/* Loop until an event is triggered, i.e. when() returns TRUE
+		 */
+		while (!ss_transition(sp, ss))
 		{
-			st->exitFunc(ss);
+			/* Check whether we have been asked to exit */
+			if (sp->die) goto exit;
+
+			DEBUG("before epicsEventMustWait(ss=%d)\n", ss - sp->ss);
+			epicsEventMustWait(ss->syncSem);
+			DEBUG("after epicsEventMustWait()\n");
 		}
 
-		/* Change to next state */
-		ss->prevState = ss->currentState;
-		ss->currentState = ss->nextState;
+		/* Check whether we have been asked to exit */
+		if (sp->die) goto exit;
 	}
 
 	/* Thread exit has been requested */
@@ -383,6 +713,88 @@ exit:
 		epicsEventSignal(ss->dead);
 }
 
+/*
+ * ss_pool_step() - Called by a pool worker when state set ss is ready:
+ * enter the first state if not yet done, then do at most one transition.
+ * After SS_STEP_EXIT, the caller must signal ss->dead.
+ */
+enum ss_step ss_pool_step(SSCB *ss)
+{
+	PROG	*sp = ss->prog;
+
+	/* The event mask is set on entering the first state */
+	if (!ss->mask)
+	{
+		ss_init(sp, ss);
+		ss_enter_state(sp, ss);
+	}
+	if (ss_transition(sp, ss))
+	{
+		if (!sp->die)
+		{
+			ss_enter_state(sp, ss);
+			return SS_STEP_AGAIN;
+		}
+	}
+	return sp->die ? SS_STEP_EXIT : SS_STEP_IDLE;
+}
+
+/*
+ * ss_coop_entry() - Main loop for option +T: run all state sets of the
+ * program in the calling thread. They share one semaphore, so a wakeup
+ * for any of them ends the wait; each pass gives every state set the
+ * chance to do one transition, and we wait only after a pass in which
+ * none of them could. Anything that blocks in an action (including
+ * synchronous pvGet and pvPut) holds up all state sets.
+ */
+static void ss_coop_entry(PROG *sp)
+{
+	unsigned nss;
+
+	taskwdInsert(sp->ss->threadId, 0, 0);
+
+	for (nss = 0; nss < sp->numSS; nss++)
+	{
+		SSCB *ss = sp->ss + nss;
+
+		ss->threadId = sp->ss->threadId;
+		ss_init(sp, ss);
+		ss_enter_state(sp, ss);
+	}
+
+	DEBUG("program %s: entering cooperative main loop\n", sp->progName);
+
+	while (TRUE)
+	{
+		boolean busy = FALSE;
+
+		for (nss = 0; nss < sp->numSS; nss++)
+		{
+			SSCB *ss = sp->ss + nss;
+
+			if (ss_transition(sp, ss))
+			{
+				if (sp->die) goto exit;
+				ss_enter_state(sp, ss);
+				busy = TRUE;
+			}
+			/* Check whether we have been asked to exit */
+			if (sp->die) goto exit;
+		}
+		if (!busy)
+		{
+			DEBUG("before epicsEventMustWait(program %s)\n", sp->progName);
+			epicsEventMustWait(sp->ss->syncSem);
+			DEBUG("after epicsEventMustWait()\n");
+			if (sp->die) goto exit;
+		}
+	}
+
+	/* Thread exit has been requested */
+exit:
+	taskwdRemove(sp->ss->threadId);
+}
+
 /*
  * Delete all state set threads and do general clean-up.
  */
@@ -400,26 +812,93 @@ epicsShareFunc void epicsShareAPI seqStop(epicsThreadId tid)
 /*
  * ss_wakeup() -- wake up each state set that is waiting on this event
  * based on the current event mask; eventNum = 0 means wake all state sets.
+ * The event is recorded as pending so the state set can tell whether
+ * it needs to re-evaluate its when() conditions.
+ *
+ * This does not take sp->lock: each state set publishes its event mask
+ * by storing the pointer to its (immutable) state's mask on state entry,
+ * followed by a memory barrier. The barrier here orders our read of the
+ * mask after whatever write caused the event, so that either we see the
+ * new mask, or the state set sees the effect of the write when it first
+ * evaluates its conditions in the new state. Wakeups are coalesced: if
+ * the event was still pending, the state set has already been signalled
+ * and will see it anyway.
  */
 void ss_wakeup(PROG *sp, unsigned eventNum)
 {
 	unsigned nss;
+	bitMask bit = 1u << (eventNum % NBITS);
+
+	seqAtomicBarrier();
 
 	/* Check event number against mask for all state sets: */
 	for (nss = 0; nss < sp->numSS; nss++)
 	{
 		SSCB *ss = sp->ss + nss;
+		const bitMask *mask = ss->mask;
 
-		epicsMutexMustLock(sp->lock);
 		/* If event bit in mask is set, wake that state set */
 		DEBUG("ss_wakeup: eventNum=%d, mask=%u, state set=%d\n", eventNum, 
-			ss->mask? *ss->mask : 0, (int)ssNum(ss));
-		if (eventNum == 0 || 
-			(ss->mask && bitTest(ss->mask, eventNum)))
+			mask? *mask : 0, (int)ssNum(ss));
+		if (eventNum == 0 || (mask && bitTest(mask, eventNum)))
 		{
-			DEBUG("ss_wakeup: waking up state set=%d\n", (int)ssNum(ss));
-			epicsEventSignal(ss->syncSem); /* wake up ss thread */
+			if (!(seqAtomicOr(ss->pending + eventNum/NBITS, bit) & bit))
+			{
+				DEBUG("ss_wakeup: waking up state set=%d\n", (int)ssNum(ss));
+				epicsEventSignal(ss->syncSem); /* wake up ss thread */
+				if (sp->pooled)
+					seqPoolWakeup(ss);
+			}
 		}
-		epicsMutexUnlock(sp->lock);
 	}
 }
+
+/*
+ * ss_queue_defer() -- called after an element has been added to the
+ * queue of ch. Return whether to defer setting the synced event flag
+ * and waking up state sets, because the queue has not yet reached the
+ * channel's wakeup watermark. In that case, start the timer (if any)
+ * that wakes up state sets queueTimeout seconds after the first deferred
+ * element. Reaching the watermark does not cancel the timer, which at
+ * worst causes one superfluous wakeup.
+ */
+boolean ss_queue_defer(CHAN *ch)
+{
+	if (ch->queueWatermark <= 1 || seqQueueUsed(ch->queue) >= ch->queueWatermark)
+		return FALSE;
+	if (ch->queueTimer && seqAtomicCas(&ch->queueTimerArmed, 0u, 1u) == 0u)
+		epicsTimerStartDelay(ch->queueTimer, ch->queueTimeout);
+	return TRUE;
+}
+
+/*
+ * ss_queue_timer_expired() - Queue timer callback, called from the
+ * shared timer queue's thread.
+ */
+void ss_queue_timer_expired(void *arg)
+{
+	CHAN *ch = (CHAN *)arg;
+	PROG *sp = ch->prog;
+
+	seqAtomicAnd(&ch->queueTimerArmed, 0u);
+	if (seqQueueIsEmpty(ch->queue))
+		return;
+	if (ch->syncedTo)
+		seq_efSet(sp->ss, ch->syncedTo);
+	ss_wakeup(sp, ch->eventNum);
+}
+
+/*
+ * ss_signal() -- wake up the given state set unconditionally, e.g.
+ * because a request it might be waiting for has completed. This
+ * forces re-evaluation of the when() conditions. Unlike ss_wakeup,
+ * always signal the semaphore, since pvGet and pvPut wait for it
+ * while the pending bit may already be set.
+ */
+void ss_signal(SSCB *ss)
+{
+	seqAtomicOr(ss->pending, 1u);
+	epicsEventSignal(ss->syncSem);
+	if (ss->prog->pooled)
+		seqPoolWakeup(ss);
+}
@@ -42,7 +42,7 @@ static void assign_subscript(ChanList *chan_list, Node *defn, Var *vp, Node *sub
 static void assign_single(ChanList *chan_list, Node *defn, Var *vp, Node *pv_name);
 static void assign_multi(ChanList *chan_list, Node *defn, Var *vp, Node *pv_name_list);
 static Chan *new_channel(ChanList *chan_list, Var *vp, uint count, uint index);
-static SyncQ *new_sync_queue(SyncQList *syncq_list, uint size);
+static SyncQ *new_sync_queue(SyncQList *syncq_list, uint size, const char *policy, uint bytes);
 static void connect_variables(SymTable st, Node *scope);
 static void connect_state_change_stmts(SymTable st, Node *scope);
 static uint connect_states(SymTable st, Node *ss_list);
@@ -50,6 +50,8 @@ static void check_states_reachable_from_first(Node *ss);
 static void add_var(Var *vp, Node *scope);
 static Var *find_var(SymTable st, char *name, Node *scope);
 static uint assign_ef_bits(Node *scope);
+static void mark_incremental_whens(Program *p);
+static void find_used_vars(Node *prog);
 
 Program *analyse_program(Node *prog, Options options)
 {
@@ -89,6 +91,9 @@ Program *analyse_program(Node *prog, Options options)
 	foreach(ss, prog->prog_statesets)
 		check_states_reachable_from_first(ss);
 	p->num_event_flags = assign_ef_bits(p->prog);
+	mark_incremental_whens(p);
+	if (p->options.safe)
+		find_used_vars(prog);
 	return p;
 }
 
@@ -292,10 +297,13 @@ static void analyse_option(Options *options, Node *defn)
 		switch(*optname)
 		{
 		case 'a': options->async = optval; break;
+		case 'b': options->batch = optval; break;
 		case 'c': options->conn = optval; break;
 		case 'd': options->debug = optval; break;
 		case 'e': options->newef = optval; break;
 		case 'l': options->line = optval; break;
+		case 'L': options->lockfree = optval; break;
+		case 'T': options->coop = optval; break;
 		case 'm': options->main = optval; break;
 		case 'r': options->reent = optval; break;
 		case 's': options->safe = optval; break;
@@ -1073,12 +1081,29 @@ static void syncq_elem(Node *defn, Var *vp, Node *subscr, SyncQ *qp)
 	vp->chan.multi[n_subscr]->syncq = qp;		/* do it */
 }
 
+/* syncq overflow policies and their C names */
+static const struct {
+	const char *name;
+	const char *c_name;
+} syncq_policies[] = {
+	{ "overwrite_last",	"SYNCQ_OVERWRITE_LAST"	},
+	{ "drop_oldest",	"SYNCQ_DROP_OLDEST"	},
+	{ "drop_newest",	"SYNCQ_DROP_NEWEST"	},
+	{ "block",		"SYNCQ_BLOCK"		},
+	{ 0,			0			}
+};
+
 static void analyse_syncq(SymTable st, SyncQList *syncq_list, Node *scope, Node *defn)
 {
 	char	*var_name;
 	Var	*vp, *evp = 0;
 	SyncQ	*qp;
 	uint	n_size = 0;
+	const char *policy = 0;
+	uint	bytes = FALSE;
+	uint	watermark = 0;
+	char	*timeout = 0;
+	Node	*opt;
 
 	assert(scope);
 	assert(defn);
@@ -1120,6 +1145,71 @@ static void analyse_syncq(SymTable st, SyncQList *syncq_list, Node *scope, Node
 			defn->syncq_size->token.str);
 		return;
 	}
+	foreach (opt, defn->syncq_options)
+	{
+		char	*name = opt->token.str;
+		int	i;
+
+		if (opt->tag == E_BINOP)
+		{
+			char *value = opt->binop_right->token.str;
+
+			name = opt->binop_left->token.str;
+			if (strcmp(name, "watermark") == 0)
+			{
+				if (!strtoui(value, UINT_MAX, &watermark) || watermark < 1)
+				{
+					error_at_node(opt, "watermark '%s' out of range\n", value);
+					return;
+				}
+				if (n_size && watermark > n_size)
+				{
+					error_at_node(opt, "watermark %u exceeds queue size %u\n",
+						watermark, n_size);
+					return;
+				}
+			}
+			else if (strcmp(name, "timeout") == 0)
+			{
+				timeout = value;
+			}
+			else
+			{
+				error_at_node(opt, "unknown queue option '%s'\n", name);
+				return;
+			}
+			continue;
+		}
+		if (strcmp(name, "bytes") == 0)
+		{
+			if (bytes)
+				warning_at_node(opt, "option 'bytes' specified twice\n");
+			bytes = TRUE;
+			continue;
+		}
+		for (i = 0; syncq_policies[i].name; i++)
+		{
+			if (strcmp(name, syncq_policies[i].name) == 0)
+				break;
+		}
+		if (!syncq_policies[i].name)
+		{
+			error_at_node(opt, "unknown queue policy '%s'\n", name);
+			return;
+		}
+		if (policy)
+		{
+			error_at_node(opt, "more than one queue policy\n");
+			return;
+		}
+		policy = syncq_policies[i].c_name;
+	}
+	if (!policy)
+		policy = syncq_policies[0].c_name;
+	if (timeout && !watermark)
+	{
+		warning_at_node(defn, "queue timeout has no effect without a watermark\n");
+	}
 	if (defn->syncq_evflag)
 	{
 		char *ef_name = defn->syncq_evflag->token.str;
@@ -1144,7 +1234,9 @@ static void analyse_syncq(SymTable st, SyncQList *syncq_list, Node *scope, Node
 		}
 		evp->chan.evflag->queued = TRUE;
 	}
-	qp = new_sync_queue(syncq_list, n_size);
+	qp = new_sync_queue(syncq_list, n_size, policy, bytes);
+	qp->watermark = watermark;
+	qp->timeout = timeout;
 	if (defn->syncq_subscr)
 	{
 		if (evp)
@@ -1183,14 +1275,16 @@ static Chan *new_channel(ChanList *chan_list, Var *vp, uint count, uint index)
 }
 
 /* Allocate a sync queue structure, add it to the sync queue list,
-   and initialize members index, var, and size. Also increase sync queue
-   count in the list. */
-static SyncQ *new_sync_queue(SyncQList *syncq_list, uint size)
+   and initialize members index, size, policy, and bytes. Also increase
+   sync queue count in the list. */
+static SyncQ *new_sync_queue(SyncQList *syncq_list, uint size, const char *policy, uint bytes)
 {
 	SyncQ *qp = new(SyncQ);
 
 	qp->index = syncq_list->num_elems++;
 	qp->size = size;
+	qp->policy = policy;
+	qp->bytes = bytes;
 
 	/* add new syncqnel to syncq_list */
 	if (!syncq_list->first)
@@ -1609,3 +1703,262 @@ static uint assign_ef_bits(Node *scope)
 	}
 	return num_event_flags;
 }
+
+/* Iteratee to find expressions that may modify program variables. */
+static int iter_find_side_effects(Node *ep, Node *scope, void *parg)
+{
+	int	*impure = (int *)parg;
+	const char *op = ep->token.str;
+	size_t	len = strlen(op);
+
+	switch (ep->tag)
+	{
+	case E_FUNC:
+		if (ep->func_expr->tag != E_BUILTIN
+			|| !ep->func_expr->extra.e_builtin->pure)
+			*impure = TRUE;
+		break;
+	case E_POST:
+		*impure = TRUE;
+		break;
+	case E_PRE:
+		if (strcmp(op, "++") == 0 || strcmp(op, "--") == 0)
+			*impure = TRUE;
+		break;
+	case E_BINOP:
+		/* assignment operators */
+		if (len > 0 && op[len-1] == '=' && strcmp(op, "==") != 0
+			&& strcmp(op, "!=") != 0 && strcmp(op, "<=") != 0
+			&& strcmp(op, ">=") != 0)
+			*impure = TRUE;
+		break;
+	default:
+		assert(impossible);
+	}
+	return !*impure;
+}
+
+/*
+ * Whether the value of expression ep can change only through events
+ * in its event mask, i.e. changes of event flags and of variables
+ * assigned to channels. Variables that other state sets can see are
+ * acceptable only in safe mode, because in unsafe mode other state sets
+ * can modify them without causing an event. Set *has_event if ep
+ * refers to at least one event flag or channel.
+ */
+static int depends_on_events_only(Node *ep, int opt_safe, int *has_event)
+{
+	Node	*cep;
+	Var	*vp;
+	struct func_symbol *fsym;
+
+	switch (ep->tag)
+	{
+	case E_CONST:
+	case E_STRING:
+		return TRUE;
+	case E_PAREN:
+		return depends_on_events_only(ep->paren_expr, opt_safe, has_event);
+	case E_CAST:
+		return depends_on_events_only(ep->cast_operand, opt_safe, has_event);
+	case E_PRE:
+		if (strcmp(ep->token.str, "*") == 0 || strcmp(ep->token.str, "&") == 0)
+			return FALSE;
+		return depends_on_events_only(ep->pre_operand, opt_safe, has_event);
+	case E_BINOP:
+		return depends_on_events_only(ep->binop_left, opt_safe, has_event)
+			&& depends_on_events_only(ep->binop_right, opt_safe, has_event);
+	case E_TERNOP:
+		return depends_on_events_only(ep->ternop_cond, opt_safe, has_event)
+			&& depends_on_events_only(ep->ternop_then, opt_safe, has_event)
+			&& depends_on_events_only(ep->ternop_else, opt_safe, has_event);
+	case E_SUBSCR:
+		return depends_on_events_only(ep->subscr_operand, opt_safe, has_event)
+			&& depends_on_events_only(ep->subscr_index, opt_safe, has_event);
+	case E_FUNC:
+		/* efTest and efTestAndClear */
+		if (ep->func_expr->tag != E_BUILTIN)
+			return FALSE;
+		fsym = ep->func_expr->extra.e_builtin;
+		if (!fsym->pure || !fsym->params[0]
+			|| fsym->params[0]->type != PT_EF || fsym->params[1])
+			return FALSE;
+		foreach (cep, ep->func_args)
+		{
+			if (!depends_on_events_only(cep, opt_safe, has_event))
+				return FALSE;
+		}
+		return TRUE;
+	case E_VAR:
+		vp = ep->extra.e_var;
+		if (vp->type->tag == T_EVFLAG)
+		{
+			*has_event = TRUE;
+			return TRUE;
+		}
+		if ((vp->type->tag != T_PRIM && vp->type->tag != T_ARRAY)
+			|| vp->assign == M_NONE
+			|| (!opt_safe && vp->scope->tag == D_PROG))
+			return FALSE;
+		*has_event = TRUE;
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/*
+ * Mark when() conditions that need to be evaluated only after one of
+ * their events has occurred, because they depend on nothing else.
+ * This is only correct if no condition of the same state may modify
+ * program variables, since these modifications cause no events.
+ * Must be called after analyse_definitions, so that p->options includes
+ * the program's own option statements.
+ */
+static void mark_incremental_whens(Program *p)
+{
+	Node	*ssp, *sp, *tp;
+	int	opt_safe = p->options.safe;
+
+	foreach (ssp, p->prog->prog_statesets)
+	{
+		foreach (sp, ssp->ss_states)
+		{
+			int impure = FALSE;
+
+			foreach (tp, sp->state_whens)
+			{
+				traverse_syntax_tree(tp->when_cond,
+					bit(E_FUNC)|bit(E_POST)|bit(E_PRE)|bit(E_BINOP),
+					0, sp, iter_find_side_effects, &impure);
+			}
+			if (impure)
+				continue;
+			foreach (tp, sp->state_whens)
+			{
+				int has_event = FALSE;
+
+				if (tp->when_cond && depends_on_events_only(
+					tp->when_cond, opt_safe, &has_event) && has_event)
+				{
+					tp->extra.e_when->incremental = TRUE;
+				}
+			}
+		}
+	}
+}
+
+/* Whether vp is one of the names that give (embedded C code or C
+   functions) access to all program variables */
+int is_env_var(Var *vp)
+{
+	return vp->type->tag == T_NONE && (strcmp(vp->name, "ssId") == 0
+		|| strcmp(vp->name, "pVar") == 0 || strcmp(vp->name, NM_ENV) == 0
+		|| strcmp(vp->name, NM_VAR) == 0);
+}
+
+/* Whether vp is a member of the struct of program variables */
+static int is_prog_var(Var *vp)
+{
+	return vp->decl && vp->scope->tag == D_PROG && vp->type->tag != T_NONE
+		&& vp->type->tag != T_EVFLAG && vp->type->tag != T_FUNCTION;
+}
+
+typedef struct used_vars_args {
+	Var	**vars;
+	uint	num_vars;
+	int	use_all;	/* found something we cannot analyse */
+} used_vars_args;
+
+/* Iteratee to collect the program variables a state set refers to. */
+static int iter_used_vars(Node *ep, Node *scope, void *parg)
+{
+	used_vars_args	*uv_args = (used_vars_args *)parg;
+	Var		*vp;
+	uint		n;
+
+	switch (ep->tag)
+	{
+	case T_TEXT:
+		uv_args->use_all = TRUE;
+		return FALSE;
+	case E_FUNC:
+		/* functions defined in the program (or called through a
+		   pointer) can access all variables */
+		if (ep->func_expr->tag != E_BUILTIN && !(ep->func_expr->tag == E_VAR
+			&& ep->func_expr->extra.e_var->type->tag == T_NONE))
+			uv_args->use_all = TRUE;
+		return TRUE;
+	case E_VAR:
+		vp = ep->extra.e_var;
+		if (is_env_var(vp))
+			uv_args->use_all = TRUE;
+		if (!is_prog_var(vp))
+			return FALSE;
+		for (n = 0; n < uv_args->num_vars; n++)
+		{
+			if (uv_args->vars[n] == vp)
+				return FALSE;
+		}
+		uv_args->vars[uv_args->num_vars++] = vp;
+		return FALSE;
+	default:
+		assert(impossible);
+		return FALSE;
+	}
+}
+
+/*
+ * In safe mode, find the program variables each state set refers to, so
+ * that its local copy need not hold the others. This is not done for the
+ * first state set, because the program entry and exit blocks run on its
+ * copy, nor for state sets that contain embedded C code or call functions
+ * defined in the program.
+ */
+static void find_used_vars(Node *prog)
+{
+	Node	*ssp;
+	Var	*vp;
+	uint	num_prog_vars = 0;
+
+	foreach (vp, var_list_from_scope(prog)->first)
+	{
+		if (is_prog_var(vp))
+			num_prog_vars++;
+	}
+	foreach (ssp, prog->prog_statesets)
+	{
+		StateSet	*ss = ssp->extra.e_ss;
+		used_vars_args	uv_args;
+
+		if (ssp == prog->prog_statesets)
+			continue;
+		uv_args.vars = newArray(Var *, num_prog_vars + 1);
+		uv_args.num_vars = 0;
+		uv_args.use_all = FALSE;
+		traverse_syntax_tree(ssp, bit(E_VAR)|bit(E_FUNC)|bit(T_TEXT), 0,
+			prog, iter_used_vars, &uv_args);
+		if (uv_args.use_all)
+		{
+			free(uv_args.vars);
+			continue;
+		}
+		/* keep them in the order of declaration */
+		ss->var_subset = TRUE;
+		ss->used_vars = newArray(Var *, num_prog_vars + 1);
+		foreach (vp, var_list_from_scope(prog)->first)
+		{
+			uint n;
+
+			for (n = 0; n < uv_args.num_vars; n++)
+			{
+				if (uv_args.vars[n] == vp)
+				{
+					ss->used_vars[ss->num_used_vars++] = vp;
+					break;
+				}
+			}
+		}
+		free(uv_args.vars);
+	}
+}
@@ -44,4 +44,6 @@ Node *defn_list_from_scope(Node *scope);
 
 Program *analyse_program(Node *ep, Options options);
 
+int is_env_var(Var *vp);
+
 #endif	/*INCLanalysish*/
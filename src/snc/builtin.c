@@ -53,7 +53,7 @@ static const struct param efP       = { PT_EF, 0 };
 static const struct param pvP       = { PT_PV, 0 };
 static const struct param pvArrayP  = { PT_PV_ARRAY, 0 };
 static const struct param noDefP    = { PT_OTHER, 0 };
-static const struct param compTypeP = { PT_OTHER, "DEFAULT" };
+static const struct param compTypeP = { PT_COMP_TYPE, "DEFAULT" };
 static const struct param tmoP      = { PT_OTHER, "DEFAULT_TIMEOUT" };
 static const struct param boolP     = { PT_OTHER, "FALSE" };
 static const struct param ptrP      = { PT_OTHER, "NULL" };
@@ -67,59 +67,64 @@ static const struct param *efParams[]                    = {&efP,0};
 static const struct param *assignParams[]                = {&pvP,&noDefP,0};
 static const struct param *pvParams[]                    = {&pvP,0};
 static const struct param *pvArrayParams[]               = {&pvArrayP,&lengthP,0};
+static const struct param *pvGetQManyParams[]            = {&pvP,&noDefP,&lengthP,0};
 static const struct param *pvSyncParams[]                = {&pvP,&efP,0};
 static const struct param *pvArraySyncParams[]           = {&pvArrayP,&lengthP,&efP,0};
 static const struct param *pvGetPutParams[]              = {&pvP,&compTypeP,&tmoP,0};
+static const struct param *pvArrayGetPutParams[]         = {&pvArrayP,&lengthP,&compTypeP,&tmoP,0};
 static const struct param *pvArrayGetPutCompleteParams[] = {&pvArrayP,&lengthP,&boolP,&ptrP,0};
 /* for backward compatibility */
 static const struct param *pvPutCompleteParams[]         = {&pvP,&defLenP,&boolP,&ptrP,0};
 
 static struct func_symbol func_symbols[] =
 {
-    /* name              c_name     action_only cond_only params                    */
-    {"delay",               0,          FALSE,  TRUE,   otherParams                 },
-    {"efClear",             0,          TRUE,   FALSE,  efParams                    },
-    {"efSet",               0,          TRUE,   FALSE,  efParams                    },
-    {"efTest",              0,          FALSE,  FALSE,  efParams                    },
-    {"efTestAndClear",      0,          FALSE,  FALSE,  efParams                    },
-    {"macValueGet",         0,          FALSE,  FALSE,  otherParams                 },
-    {"optGet",              0,          FALSE,  FALSE,  otherParams                 },
-    {"pvAssign",            0,          FALSE,  FALSE,  assignParams                },
-    {"pvAssignCount",       0,          FALSE,  FALSE,  noParams                    },
-    {"pvAssignSubst",       0,          FALSE,  FALSE,  assignParams                },
-    {"pvAssigned",          0,          FALSE,  FALSE,  pvParams                    },
-    {"pvChannelCount",      0,          FALSE,  FALSE,  noParams                    },
-    {"pvConnectCount",      0,          FALSE,  FALSE,  noParams                    },
-    {"pvConnected",         0,          FALSE,  FALSE,  pvParams                    },
-    {"pvArrayConnected",    0,          FALSE,  FALSE,  pvArrayParams               },
-    {"pvCount",             0,          FALSE,  FALSE,  pvParams                    },
-    {"pvFlush",             0,          FALSE,  FALSE,  noParams                    },
-    {"pvFlushQ",            0,          FALSE,  FALSE,  pvParams                    },
-    {"pvFreeQ",             0,          FALSE,  FALSE,  pvParams                    },
-    {"pvGet",               "pvGetTmo", FALSE,  FALSE,  pvGetPutParams              },
-    {"pvGetCancel",         0,          FALSE,  FALSE,  pvParams                    },
-    {"pvArrayGetCancel",    0,          FALSE,  FALSE,  pvArrayParams               },
-    {"pvGetComplete",       0,          FALSE,  FALSE,  pvParams                    },
-    {"pvArrayGetComplete",  0,          FALSE,  FALSE,  pvArrayGetPutCompleteParams },
-    {"pvGetQ",              0,          FALSE,  FALSE,  pvParams                    },
-    {"pvIndex",             0,          FALSE,  FALSE,  pvParams                    },
-    {"pvMessage",           0,          FALSE,  FALSE,  pvParams                    },
-    {"pvMonitor",           0,          FALSE,  FALSE,  pvParams                    },
-    {"pvArrayMonitor",      0,          FALSE,  FALSE,  pvArrayParams               },
-    {"pvName",              0,          FALSE,  FALSE,  pvParams                    },
-    {"pvPut",               "pvPutTmo", FALSE,  FALSE,  pvGetPutParams              },
-    {"pvPutCancel",         0,          FALSE,  FALSE,  pvParams                    },
-    {"pvArrayPutCancel",    0,          FALSE,  FALSE,  pvArrayParams               },
-    {"pvPutComplete",       0,          FALSE,  FALSE,  pvPutCompleteParams         },
-    {"pvArrayPutComplete",  0,          FALSE,  FALSE,  pvArrayGetPutCompleteParams },
-    {"pvSeverity",          0,          FALSE,  FALSE,  pvParams                    },
-    {"pvStatus",            0,          FALSE,  FALSE,  pvParams                    },
-    {"pvStopMonitor",       0,          FALSE,  FALSE,  pvParams                    },
-    {"pvArrayStopMonitor",  0,          FALSE,  FALSE,  pvArrayParams               },
-    {"pvSync",              0,          FALSE,  FALSE,  pvSyncParams                },
-    {"pvArraySync",         0,          FALSE,  FALSE,  pvArraySyncParams           },
-    {"pvTimeStamp",         0,          FALSE,  FALSE,  pvParams                    },
-    {0,                     0,          FALSE,  FALSE,  0                           }
+    /* name              c_name     action_only cond_only pure   params                    */
+    {"delay",               0,          FALSE,  TRUE,   TRUE,   otherParams                 },
+    {"efClear",             0,          TRUE,   FALSE,  FALSE,  efParams                    },
+    {"efSet",               0,          TRUE,   FALSE,  FALSE,  efParams                    },
+    {"efTest",              0,          FALSE,  FALSE,  TRUE,   efParams                    },
+    {"efTestAndClear",      0,          FALSE,  FALSE,  TRUE,   efParams                    },
+    {"macValueGet",         0,          FALSE,  FALSE,  TRUE,   otherParams                 },
+    {"optGet",              0,          FALSE,  FALSE,  TRUE,   otherParams                 },
+    {"pvAssign",            0,          FALSE,  FALSE,  FALSE,  assignParams                },
+    {"pvAssignCount",       0,          FALSE,  FALSE,  TRUE,   noParams                    },
+    {"pvAssignSubst",       0,          FALSE,  FALSE,  FALSE,  assignParams                },
+    {"pvAssigned",          0,          FALSE,  FALSE,  TRUE,   pvParams                    },
+    {"pvChannelCount",      0,          FALSE,  FALSE,  TRUE,   noParams                    },
+    {"pvConnectCount",      0,          FALSE,  FALSE,  TRUE,   noParams                    },
+    {"pvConnected",         0,          FALSE,  FALSE,  TRUE,   pvParams                    },
+    {"pvArrayConnected",    0,          FALSE,  FALSE,  TRUE,   pvArrayParams               },
+    {"pvCount",             0,          FALSE,  FALSE,  TRUE,   pvParams                    },
+    {"pvFlush",             0,          FALSE,  FALSE,  FALSE,  noParams                    },
+    {"pvFlushQ",            0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvFreeQ",             0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvGet",               "pvGetTmo", FALSE,  FALSE,  FALSE,  pvGetPutParams              },
+    {"pvGetCancel",         0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvArrayGet",          0,          FALSE,  FALSE,  FALSE,  pvArrayGetPutParams         },
+    {"pvArrayGetCancel",    0,          FALSE,  FALSE,  FALSE,  pvArrayParams               },
+    {"pvGetComplete",       0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvArrayGetComplete",  0,          FALSE,  FALSE,  FALSE,  pvArrayGetPutCompleteParams },
+    {"pvGetQ",              0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvGetQMany",          0,          FALSE,  FALSE,  FALSE,  pvGetQManyParams            },
+    {"pvIndex",             0,          FALSE,  FALSE,  TRUE,   pvParams                    },
+    {"pvMessage",           0,          FALSE,  FALSE,  TRUE,   pvParams                    },
+    {"pvMonitor",           0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvArrayMonitor",      0,          FALSE,  FALSE,  FALSE,  pvArrayParams               },
+    {"pvName",              0,          FALSE,  FALSE,  TRUE,   pvParams                    },
+    {"pvPut",               "pvPutTmo", FALSE,  FALSE,  FALSE,  pvGetPutParams              },
+    {"pvPutCancel",         0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvArrayPut",          0,          FALSE,  FALSE,  FALSE,  pvArrayGetPutParams         },
+    {"pvArrayPutCancel",    0,          FALSE,  FALSE,  FALSE,  pvArrayParams               },
+    {"pvPutComplete",       0,          FALSE,  FALSE,  FALSE,  pvPutCompleteParams         },
+    {"pvArrayPutComplete",  0,          FALSE,  FALSE,  FALSE,  pvArrayGetPutCompleteParams },
+    {"pvSeverity",          0,          FALSE,  FALSE,  TRUE,   pvParams                    },
+    {"pvStatus",            0,          FALSE,  FALSE,  TRUE,   pvParams                    },
+    {"pvStopMonitor",       0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvArrayStopMonitor",  0,          FALSE,  FALSE,  FALSE,  pvArrayParams               },
+    {"pvSync",              0,          FALSE,  FALSE,  FALSE,  pvSyncParams                },
+    {"pvArraySync",         0,          FALSE,  FALSE,  FALSE,  pvArraySyncParams           },
+    {"pvTimeStamp",         0,          FALSE,  FALSE,  TRUE,   pvParams                    },
+    {0,                     0,          FALSE,  FALSE,  FALSE,  0                           }
 };
 
 /* Insert builtin constants into symbol table */
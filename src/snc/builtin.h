@@ -23,6 +23,7 @@ enum param_type {
     PT_EF,
     PT_PV,
     PT_PV_ARRAY,
+    PT_COMP_TYPE,
     PT_OTHER
 };
 
@@ -36,6 +37,7 @@ struct func_symbol {
     const char *c_name;         /* C name, or 0 if same as SNL name */
     uint action_only:1;         /* not allowed in when-conditions */
     uint cond_only:1;           /* only allowed in when-conditions */
+    uint pure:1;                /* does not modify program variables */
     const struct param **params;/* parameter descriptions */
 };
 
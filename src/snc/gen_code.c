@@ -26,6 +26,7 @@ static const int impossible = 0;
 
 static void gen_main(char *prog_name);
 static void gen_var_struct(Node *prog, uint opt_reent);
+static void gen_ss_var_structs(Node *prog);
 static void gen_init_reg(char *prog_name);
 static void gen_func_decls(Node *prog);
 static void gen_global_defn(Node *defn);
@@ -74,6 +75,8 @@ void generate_code(Program *p)
 
 	/* Variable declarations */
 	gen_var_struct(p->prog, p->options.reent);
+	if (p->options.safe)
+		gen_ss_var_structs(p->prog);
 
 	/* Function declarations */
 	gen_func_decls(p->prog);
@@ -168,21 +171,8 @@ static void gen_var_struct(Node *prog, uint opt_reent)
 	foreach (ssp, prog->prog_statesets)
 	{
 		int level = opt_reent;
-		int ss_empty = !ssp->extra.e_ss->var_list->first;
 
-		if (ss_empty)
-		{
-			foreach (sp, ssp->ss_states)
-			{
-				if (sp->extra.e_state->var_list->first)
-				{
-					ss_empty = 0;
-					break;
-				}
-			}
-		}
-
-		if (!ss_empty)
+		if (ss_has_vars(ssp))
 		{
 			indent(level); gen_code("struct %s_%s {\n", NM_VARS, ssp->token.str);
 			foreach (vp, ssp->extra.e_ss->var_list->first)
@@ -223,6 +213,61 @@ static void gen_var_struct(Node *prog, uint opt_reent)
 	gen_code("\n");
 }
 
+/* Whether state set ssp or one of its states declares variables, i.e.
+   whether there is a nested struct for it */
+int ss_has_vars(Node *ssp)
+{
+	Node	*sp;
+
+	if (ssp->extra.e_ss->var_list->first)
+		return TRUE;
+	foreach (sp, ssp->ss_states)
+	{
+		if (sp->extra.e_state->var_list->first)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* In safe mode, generate a struct for the local copy of each state set
+   that uses only some of the top-level variables. It has members of the
+   same names as the struct of all variables, so the state set's code
+   is generated in the same way. */
+static void gen_ss_var_structs(Node *prog)
+{
+	Node	*ssp;
+	uint	n;
+
+	foreach (ssp, prog->prog_statesets)
+	{
+		StateSet *ss = ssp->extra.e_ss;
+
+		if (!ss->var_subset)
+			continue;
+		gen_code("/* Local copy of variables for state set \"%s\" */\n",
+			ssp->token.str);
+		gen_code("struct %s_%s {\n", NM_SSVARS, ssp->token.str);
+		for (n = 0; n < ss->num_used_vars; n++)
+		{
+			Var *vp = ss->used_vars[n];
+
+			gen_line_marker(vp->decl);
+			indent(1); gen_var_decl(vp); gen_code(";\n");
+		}
+		if (ss_has_vars(ssp))
+		{
+			indent(1);
+			gen_code("struct %s_%s %s_%s;\n", NM_VARS, ssp->token.str,
+				NM_VARS, ssp->token.str);
+		}
+		else if (!ss->num_used_vars)
+		{
+			indent(1); gen_code("char " NM_DUMMY ";\n");
+		}
+		gen_code("};\n\n");
+	}
+}
+
 /* Generate C code in definition section */
 void gen_defn_c_code(Node *scope, int level)
 {
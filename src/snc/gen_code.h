@@ -19,12 +19,15 @@ void generate_code(Program *p);
 void gen_defn_c_code(Node *scope, int level);
 void gen_var_decl(Var *vp);
 void indent(int level);
+int ss_has_vars(Node *ssp);
 
 /* names and name prefixes for generated structs */
 #define NM_VARS		"seqg_vars"
 #define NM_CHANS	"seqg_chans"
 #define NM_STATES	"seqg_states"
 #define NM_STATESETS	"seqg_statesets"
+#define NM_SSVARS	"seqg_ssvars"
+#define NM_FIELDS	"seqg_fields"
 
 /* names and name prefixes for generated functions */
 #define NM_ENTRY	"seqg_entry"
@@ -33,6 +36,8 @@ void indent(int level);
 #define NM_ACTION	"seqg_action"
 #define NM_EVENT	"seqg_event"
 #define NM_MASK		"seqg_mask"
+#define NM_TRANSMASK	"seqg_transmask"
+#define NM_READMASK	"seqg_readmask"
 
 /* names of generated function arguments */
 #define NM_VAR		"seqg_var"
@@ -53,6 +53,10 @@ static void gen_pv_arg(
 	Node		*ap,		/* argument expression */
 	uint		index,		/* argument index */
 	uint		pv_array);	/* function expects a pv array */
+static void check_comp_type_arg(
+	Node		*ep,		/* function call */
+	const char	*func_name,	/* function name */
+	Node		*ap);		/* argument expression or 0 */
 
 static void gen_prog_func(
 	Node *prog,
@@ -113,6 +117,14 @@ void gen_ss_code(Node *prog, Options options)
 	/* For each state set ... */
 	foreach (ssp, prog->prog_statesets)
 	{
+		/* Its local copy may hold only the variables it uses */
+		if (ssp->extra.e_ss->var_subset)
+		{
+			gen_code("\n#undef " NM_VAR "\n");
+			gen_code("#define " NM_VAR " (*(struct " NM_SSVARS "_%s *const *)" NM_ENV ")\n",
+				ssp->token.str);
+		}
+
 		/* For each state ... */
 		foreach (sp, ssp->ss_states)
 		{
@@ -139,6 +151,11 @@ void gen_ss_code(Node *prog, Options options)
 				C_TRANS, "Action", NM_ACTION, "void",
 				", int "NM_TRN", int *"NM_PNST);
 		}
+		if (ssp->extra.e_ss->var_subset)
+		{
+			gen_code("\n#undef " NM_VAR "\n");
+			gen_code("#define " NM_VAR " (*(struct " NM_VARS " *const *)" NM_ENV ")\n");
+		}
 		ss_num++;
 	}
 
@@ -272,6 +289,13 @@ static void gen_event_body(Node *xp, int context)
 		indent(level); gen_code("if (");
 		if (tp->when_cond == 0)
 			gen_code("TRUE");
+		else if (tp->extra.e_when->incremental)
+		{
+			/* skip if none of its events occurred since last time */
+			gen_code("seq_transChanged(" NM_ENV ", %d) && (", trans_num);
+			gen_expr(C_COND, tp->when_cond, 0);
+			gen_code(")");
+		}
 		else
 			gen_expr(C_COND, tp->when_cond, 0);
 		gen_code(")\n");
@@ -568,6 +592,8 @@ static void gen_builtin_call(int context, Node *ep)
 	{
 		const struct param *pp = *ppp;
 		gen_code(", ");
+		if (pp->type == PT_COMP_TYPE)
+			check_comp_type_arg(ep, fsym->name, ap);
 		if (!ap)
 		{
 			if (pp->default_value)
@@ -584,6 +610,7 @@ static void gen_builtin_call(int context, Node *ep)
 		{
 			switch(pp->type)
 			{
+			case PT_COMP_TYPE:
 			case PT_OTHER:
 				gen_expr(context, ap, 0);
 				break;
@@ -609,6 +636,35 @@ static void gen_builtin_call(int context, Node *ep)
 	gen_code(")");
 }
 
+/* With option +T, a synchronous request would block all state sets
+   until it completes, so allow only asynchronous ones */
+static void check_comp_type_arg(
+	Node		*ep,		/* function call */
+	const char	*func_name,	/* function name */
+	Node		*ap		/* argument expression or 0 */
+)
+{
+	uint sync;
+
+	if (!global_options.coop)
+		return;
+	if (!ap)
+		sync = !global_options.async;
+	else if (ap->tag == E_CONST)
+		sync = strcmp(ap->extra.e_const->name, "SYNC") == 0;
+	else
+		return;
+	if (sync)
+	{
+		error_at_node(ap ? ap : ep,
+			"synchronous %s is not allowed with option +T, "
+			"since it would block all state sets\n", func_name);
+		report_at_node(ap ? ap : ep,
+			"Perhaps you meant to call %s(..., ASYNC) and wait "
+			"for %sComplete?\n", func_name, func_name);
+	}
+}
+
 /* Check an event flag argument */
 static void gen_ef_arg(
 	int		context,
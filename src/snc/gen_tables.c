@@ -21,6 +21,7 @@ in the file LICENSE that is included with this distribution.
 #include "gen_code.h"
 #include "node.h"
 #include "var_types.h"
+#include "type_check.h"
 #include "gen_tables.h"
 #include "seq_mask.h"
 #include "seq_release.h"
@@ -30,25 +31,56 @@ typedef struct event_mask_args {
 	uint	num_event_flags;
 } event_mask_args;
 
+typedef struct read_mask_args {
+	seqMask	*chan_words;
+	int	read_all;	/* found something we cannot analyse */
+} read_mask_args;
+
 static void gen_channel_table(ChanList *chan_list, uint num_event_flags, int opt_reent);
 static void gen_channel(Chan *cp, uint num_event_flags, int opt_reent);
-static void gen_state_table(Node *ss_list, uint num_event_flags, uint num_channels);
+static void gen_state_table(Node *ss_list, uint num_event_flags, uint num_channels,
+	seqMask *aliased_words);
 static void fill_state_struct(Node *sp, char *ss_name, uint ss_num);
 static void gen_prog_table(Program *p);
 static void encode_options(Options options);
 static void encode_state_options(StateOptions options);
 static void gen_ss_table(Node *ss_list);
+static uint num_var_fields(Node *ssp);
+static void gen_ss_var_fields(Node *ssp);
+static void gen_var_field(const char *ss_name, const char *prefix, const char *name);
 static void gen_state_event_mask(Node *sp, uint num_event_flags,
-	seqMask *event_words, uint num_event_words);
+	seqMask *event_words, seqMask *trans_words, uint num_event_words);
+static void when_event_mask(Node *tp, uint num_event_flags,
+	seqMask *event_words);
+static int state_has_incremental_whens(Node *sp);
 static int iter_event_mask_scalar(Node *ep, Node *scope, void *parg);
 static int iter_event_mask_array(Node *ep, Node *scope, void *parg);
+static int gen_state_read_mask(Node *sp, seqMask *chan_words,
+	seqMask *aliased_words, uint num_chan_words);
+static int iter_read_mask(Node *ep, Node *scope, void *parg);
+static void read_mask_var(Var *vp, seqMask *chan_words);
+static int iter_aliased_channels(Node *ep, Node *scope, void *parg);
+static void aliased_channels(Node *ep, seqMask *chan_words);
 
 /* Generate all kinds of tables for a SNL program. */
 void gen_tables(Program *p)
 {
+	uint	num_channels = p->chan_list->num_elems;
+	seqMask	*aliased_words = 0;
+
+	/* In safe mode, find channels that may be accessed via pointers;
+	   these must be read in every state */
+	if (p->options.safe && num_channels > 0)
+	{
+		aliased_words = newArray(seqMask, NWORDS(num_channels));
+		traverse_syntax_tree(p->prog,
+			bit(E_BINOP)|bit(E_FUNC)|bit(E_PRE)|bit(D_DECL)|bit(S_RETURN),
+			0, 0, iter_aliased_channels, aliased_words);
+	}
 	gen_code("\n/************************ Tables ************************/\n");
 	gen_channel_table(p->chan_list, p->num_event_flags, p->options.reent);
-	gen_state_table(p->prog->prog_statesets, p->num_event_flags, p->chan_list->num_elems);
+	gen_state_table(p->prog->prog_statesets, p->num_event_flags, num_channels,
+		aliased_words);
 	gen_ss_table(p->prog->prog_statesets);
 	gen_prog_table(p);
 }
@@ -62,7 +94,7 @@ static void gen_channel_table(ChanList *chan_list, uint num_event_flags, int opt
 	{
 		gen_code("\n/* Channel table */\n");
 		gen_code("static seqChan " NM_CHANS "[] = {\n");
-		gen_code("\t/* chName, offset, varName, varType, count, eventNum, efId, monitored, queueSize, queueIndex */\n");
+		gen_code("\t/* chName, offset, varName, varType, count, eventNum, efId, monitored, queueSize, queueIndex, queuePolicy, queueBytes, queueWatermark, queueTimeout */\n");
 		foreach (cp, chan_list->first)
 		{
 			gen_channel(cp, num_event_flags, opt_reent);
@@ -168,23 +200,33 @@ static void gen_channel(Chan *cp, uint num_event_flags, int opt_reent)
 	gen_code("%d, ", cp->monitor);
 	/* syncQ queue */
 	if (!cp->syncq)
-		gen_code("0, 0");
-	else if (!cp->syncq->size)
-		gen_code("DEFAULT_QUEUE_SIZE, %d", cp->syncq->index);
+		gen_code("0, 0, SYNCQ_OVERWRITE_LAST, 0, 0, 0");
 	else
-		gen_code("%d, %d", cp->syncq->size, cp->syncq->index);
+	{
+		if (!cp->syncq->size)
+			gen_code("DEFAULT_QUEUE_SIZE, ");
+		else
+			gen_code("%d, ", cp->syncq->size);
+		gen_code("%d, %s, %d, %d, %s", cp->syncq->index, cp->syncq->policy,
+			cp->syncq->bytes, cp->syncq->watermark,
+			cp->syncq->timeout ? cp->syncq->timeout : "0");
+	}
 	gen_code("}");
 }
 
-/* Generate state event mask and table */
-static void gen_state_table(Node *ss_list, uint num_event_flags, uint num_channels)
+/* Generate state event mask and table. If aliased_words is not NULL,
+   also generate read masks. */
+static void gen_state_table(Node *ss_list, uint num_event_flags, uint num_channels,
+	seqMask *aliased_words)
 {
 	Node	*ssp;
 	Node	*sp;
 	uint	n;
 	uint	num_event_words = NWORDS(num_event_flags + num_channels);
+	uint	num_chan_words = NWORDS(num_channels);
 	uint	ss_num = 0;
 	seqMask	*event_mask = newArray(seqMask, num_event_words);
+	seqMask	*read_mask = newArray(seqMask, num_chan_words);
 
 	/* NOTE: Bit zero of event mask is not used. Bit 1 to num_event_flags
 	   are used for event flags, then come channels. */
@@ -196,12 +238,48 @@ static void gen_state_table(Node *ss_list, uint num_event_flags, uint num_channe
 		gen_code("\n/* Event masks for state set \"%s\" */\n", ssp->token.str);
 		foreach (sp, ssp->ss_states)
 		{
-			gen_state_event_mask(sp, num_event_flags, event_mask, num_event_words);
+			Node	*tp;
+			uint	num_whens = 0;
+			seqMask	*trans_mask;
+
+			foreach (tp, sp->state_whens)
+				num_whens++;
+			trans_mask = newArray(seqMask, num_whens * num_event_words + 1);
+			gen_state_event_mask(sp, num_event_flags, event_mask,
+				trans_mask, num_event_words);
 			gen_code("static const seqMask " NM_MASK "_%s_%d_%s[] = {\n",
 				ssp->token.str, ss_num, sp->token.str);
 			for (n = 0; n < num_event_words; n++)
 				gen_code("\t0x%08x,\n", event_mask[n]);
 			gen_code("};\n");
+			if (state_has_incremental_whens(sp))
+			{
+				seqMask *tm = trans_mask;
+				uint trans_num = 0;
+
+				gen_code("static const seqMask " NM_TRANSMASK "_%s_%d_%s[] = {\n",
+					ssp->token.str, ss_num, sp->token.str);
+				foreach (tp, sp->state_whens)
+				{
+					gen_code("\t/* transition %d */\n", trans_num++);
+					for (n = 0; n < num_event_words; n++, tm++)
+						gen_code("\t0x%08x,\n",
+							tp->extra.e_when->incremental ? *tm : 0);
+				}
+				gen_code("};\n");
+			}
+			free(trans_mask);
+			sp->extra.e_state->has_read_mask = aliased_words &&
+				gen_state_read_mask(sp, read_mask, aliased_words,
+					num_chan_words);
+			if (sp->extra.e_state->has_read_mask)
+			{
+				gen_code("static const seqMask " NM_READMASK "_%s_%d_%s[] = {\n",
+					ssp->token.str, ss_num, sp->token.str);
+				for (n = 0; n < num_chan_words; n++)
+					gen_code("\t0x%08x,\n", read_mask[n]);
+				gen_code("};\n");
+			}
 		}
 
 		/* Generate table of state structures */
@@ -236,6 +314,16 @@ static void fill_state_struct(Node *sp, char *ss_name, uint ss_num)
 	gen_code("\t/* event mask array */  " NM_MASK "_%s_%d_%s,\n", ss_name, ss_num, sp->token.str);
 	gen_code("\t/* state options */     ");
 	encode_state_options(sp->extra.e_state->options);
+	gen_code(",\n\t/* transition masks */  ");
+	if (state_has_incremental_whens(sp))
+		gen_code(NM_TRANSMASK "_%s_%d_%s,\n", ss_name, ss_num, sp->token.str);
+	else
+		gen_code("0,\n");
+	gen_code("\t/* read mask */         ");
+	if (sp->extra.e_state->has_read_mask)
+		gen_code(NM_READMASK "_%s_%d_%s", ss_name, ss_num, sp->token.str);
+	else
+		gen_code("0");
 	gen_code("\n\t},\n");
 }
 
@@ -252,12 +340,52 @@ static void encode_state_options(StateOptions options)
 	gen_code(")");
 } 
 
+/* Number of entries in the table of variables in the local copy of a
+   state set: the top-level variables it uses, and its own variables */
+static uint num_var_fields(Node *ssp)
+{
+	return ssp->extra.e_ss->num_used_vars + (ss_has_vars(ssp) ? 1 : 0);
+}
+
+/* Generate the table of variables in the local copy of a state set,
+   see gen_ss_var_structs */
+static void gen_ss_var_fields(Node *ssp)
+{
+	StateSet	*ss = ssp->extra.e_ss;
+	uint		n;
+
+	gen_code("\n/* Variables in the local copy of state set \"%s\" */\n",
+		ssp->token.str);
+	gen_code("static seqVarField " NM_FIELDS "_%s[] = {\n", ssp->token.str);
+	for (n = 0; n < ss->num_used_vars; n++)
+		gen_var_field(ssp->token.str, "", ss->used_vars[n]->name);
+	if (ss_has_vars(ssp))
+		gen_var_field(ssp->token.str, NM_VARS "_", ssp->token.str);
+	gen_code("};\n");
+}
+
+/* Generate an entry in the table of variables in the local copy */
+static void gen_var_field(const char *ss_name, const char *prefix, const char *name)
+{
+	gen_code("\t{offsetof(struct %s, %s%s), offsetof(struct %s_%s, %s%s), "
+		"sizeof(((struct %s *)0)->%s%s)},\n", NM_VARS, prefix, name,
+		NM_SSVARS, ss_name, prefix, name, NM_VARS, prefix, name);
+}
+
 /* Generate state set table, one entry for each state set */
 static void gen_ss_table(Node *ss_list)
 {
 	Node	*ssp;
 	int	num_ss;
 
+	foreach (ssp, ss_list)
+	{
+		StateSet *ss = ssp->extra.e_ss;
+
+		if (ss->var_subset && num_var_fields(ssp) > 0)
+			gen_ss_var_fields(ssp);
+	}
+
 	gen_code("\n/* State set table */\n");
 	gen_code("static seqSS " NM_STATESETS "[] = {\n");
 	num_ss = 0;
@@ -269,7 +397,26 @@ static void gen_ss_table(Node *ss_list)
 		gen_code("\t{\n");
 		gen_code("\t/* state set name */    \"%s\",\n", ssp->token.str);
 		gen_code("\t/* states */            " NM_STATES "_%s,\n", ssp->token.str);
-		gen_code("\t/* number of states */  %d\n", ssp->extra.e_ss->num_states);
+		gen_code("\t/* number of states */  %d,\n", ssp->extra.e_ss->num_states);
+		if (ssp->extra.e_ss->var_subset)
+		{
+			uint num_fields = num_var_fields(ssp);
+
+			gen_code("\t/* local variables */   ");
+			if (num_fields > 0)
+				gen_code(NM_FIELDS "_%s,\n", ssp->token.str);
+			else
+				gen_code("0,\n");
+			gen_code("\t/* num. local vars */   %d,\n", num_fields);
+			gen_code("\t/* local var size */    sizeof(struct " NM_SSVARS "_%s)\n",
+				ssp->token.str);
+		}
+		else
+		{
+			gen_code("\t/* local variables */   0,\n");
+			gen_code("\t/* num. local vars */   0,\n");
+			gen_code("\t/* local var size */    0\n");
+		}
 		gen_code("\t},\n");
 	}
 	gen_code("};\n");
@@ -315,6 +462,12 @@ static void encode_options(Options options)
 		gen_code(" | OPT_REENT");
 	if (options.safe)
 		gen_code(" | OPT_SAFE");
+	if (options.lockfree)
+		gen_code(" | OPT_LOCKFREE");
+	if (options.batch)
+		gen_code(" | OPT_BATCH");
+	if (options.coop)
+		gen_code(" | OPT_COOP");
 	gen_code("),\n");
 }
 
@@ -325,7 +478,7 @@ static void encode_options(Options options)
    are for process variables. Bit zero is not used for whatever mysterious reason
    I cannot tell. */
 static void gen_state_event_mask(Node *sp, uint num_event_flags,
-	seqMask *event_words, uint num_event_words)
+	seqMask *event_words, seqMask *trans_words, uint num_event_words)
 {
 	uint	n;
 	Node	*tp;
@@ -337,18 +490,16 @@ static void gen_state_event_mask(Node *sp, uint num_event_flags,
 	 * and assigned variables.  Database variables might have a subscript,
 	 * which could be a constant (set a single event bit) or an expression
 	 * (set a group of bits for the possible range of the evaluated expression)
+	 * The state's mask is the union of the masks of its transitions.
 	 */
 	foreach (tp, sp->state_whens)
 	{
-		event_mask_args em_args = { event_words, num_event_flags };
-
-		/* look for scalar variables and event flags */
-		traverse_syntax_tree(tp->when_cond, bit(E_VAR), 0, 0,
-			iter_event_mask_scalar, &em_args);
-
-		/* look for arrays and subscripted array elements */
-		traverse_syntax_tree(tp->when_cond, bit(E_VAR)|bit(E_SUBSCR), 0, 0,
-			iter_event_mask_array, &em_args);
+		for (n = 0; n < num_event_words; n++)
+			trans_words[n] = 0;
+		when_event_mask(tp, num_event_flags, trans_words);
+		for (n = 0; n < num_event_words; n++)
+			event_words[n] |= trans_words[n];
+		trans_words += num_event_words;
 	}
 #ifdef DEBUG
 	report("event mask for state %s is", sp->token.str);
@@ -358,6 +509,34 @@ static void gen_state_event_mask(Node *sp, uint num_event_flags,
 #endif
 }
 
+/* Add the events that the condition of transition tp refers to */
+static void when_event_mask(Node *tp, uint num_event_flags,
+	seqMask *event_words)
+{
+	event_mask_args em_args = { event_words, num_event_flags };
+
+	/* look for scalar variables and event flags */
+	traverse_syntax_tree(tp->when_cond, bit(E_VAR), 0, 0,
+		iter_event_mask_scalar, &em_args);
+
+	/* look for arrays and subscripted array elements */
+	traverse_syntax_tree(tp->when_cond, bit(E_VAR)|bit(E_SUBSCR), 0, 0,
+		iter_event_mask_array, &em_args);
+}
+
+/* Whether any condition of state sp is evaluated incrementally */
+static int state_has_incremental_whens(Node *sp)
+{
+	Node	*tp;
+
+	foreach (tp, sp->state_whens)
+	{
+		if (tp->extra.e_when->incremental)
+			return TRUE;
+	}
+	return FALSE;
+}
+
 #define bitnum(var_ix, ch_ix, num_efs) ((var_ix)+(ch_ix)+(num_efs)+1)
 
 /* Iteratee for scalar variables (including event flags). */
@@ -503,3 +682,183 @@ static int iter_event_mask_array(Node *ep, Node *scope, void *parg)
 		}
 	}
 }
+
+/* Generate the read mask for a single state, i.e. the channels that safe mode
+   must copy to the state set's variables before the state's conditions are
+   evaluated. These are the channels referenced in the state's conditions,
+   its actions, its exit block, and the entry blocks of its target states,
+   plus the aliased ones. Return FALSE if all channels must be read. */
+static int gen_state_read_mask(Node *sp, seqMask *chan_words,
+	seqMask *aliased_words, uint num_chan_words)
+{
+	uint		n;
+	Node		*tp;
+	read_mask_args	rm_args = { chan_words, FALSE };
+	TypeMask	call_mask = bit(E_VAR)|bit(E_SUBSCR)|bit(E_FUNC)|bit(S_CHANGE)|bit(T_TEXT);
+
+	for (n = 0; n < num_chan_words; n++)
+		chan_words[n] = aliased_words[n];
+
+	foreach (tp, sp->state_whens)
+	{
+		Node *next_sp = tp->extra.e_when->next_state;
+
+		traverse_syntax_tree(tp, call_mask, 0, sp, iter_read_mask, &rm_args);
+		if (next_sp)
+			traverse_syntax_tree(next_sp->state_entry, call_mask, 0,
+				next_sp, iter_read_mask, &rm_args);
+	}
+	traverse_syntax_tree(sp->state_exit, call_mask, 0, sp, iter_read_mask, &rm_args);
+	return !rm_args.read_all;
+}
+
+/* Iteratee for the read mask. */
+static int iter_read_mask(Node *ep, Node *scope, void *parg)
+{
+	read_mask_args	*rm_args = (read_mask_args *)parg;
+	Var		*vp;
+
+	switch (ep->tag)
+	{
+	case T_TEXT:
+		/* embedded C code can access any variable */
+		rm_args->read_all = TRUE;
+		return FALSE;
+	case S_CHANGE:
+		/* the target state's entry block runs before we read again */
+		traverse_syntax_tree(ep->extra.e_change->state_entry,
+			bit(E_VAR)|bit(E_SUBSCR)|bit(E_FUNC)|bit(T_TEXT), 0,
+			ep->extra.e_change, iter_read_mask, rm_args);
+		return FALSE;
+	case E_FUNC:
+		/* so can functions defined in the program */
+		if (ep->func_expr->tag != E_BUILTIN && type_is_function(ep->func_expr))
+			rm_args->read_all = TRUE;
+		return TRUE;
+	case E_SUBSCR:
+		/* an element of a multi-channel array with constant subscript */
+		if (ep->subscr_operand->tag == E_VAR && ep->subscr_index->tag == E_CONST)
+		{
+			uint ix;
+
+			vp = ep->subscr_operand->extra.e_var;
+			if (vp->assign == M_MULTI && strtoui(ep->subscr_index->token.str,
+				type_array_length1(vp->type), &ix))
+			{
+				bitSet(rm_args->chan_words, vp->index + ix);
+				return FALSE;
+			}
+		}
+		return TRUE;
+	case E_VAR:
+		vp = ep->extra.e_var;
+		/* can be passed to C functions */
+		if (is_env_var(vp))
+			rm_args->read_all = TRUE;
+		read_mask_var(vp, rm_args->chan_words);
+		return FALSE;
+	default:
+		assert(FALSE);
+		return FALSE;
+	}
+}
+
+/* Set the bits for all channels assigned to variable vp */
+static void read_mask_var(Var *vp, seqMask *chan_words)
+{
+	uint ix;
+
+	if (vp->assign == M_NONE)
+		return;
+	if (vp->assign == M_SINGLE)
+	{
+		bitSet(chan_words, vp->index + vp->chan.single->index);
+		return;
+	}
+	for (ix = 0; ix < type_array_length1(vp->type); ix++)
+		bitSet(chan_words, vp->index + ix);
+}
+
+/* Iteratee to find channels whose variables may be accessed through a
+   pointer that is stored somewhere: their address is taken, or an array
+   or string is assigned, initializes a declaration, is returned, or is
+   passed to a function defined in the program. */
+static int iter_aliased_channels(Node *ep, Node *scope, void *parg)
+{
+	seqMask	*chan_words = (seqMask *)parg;
+	Node	*cep;
+
+	switch (ep->tag)
+	{
+	case E_PRE:
+		if (strcmp(ep->token.str, "&") == 0)
+			traverse_syntax_tree(ep->pre_operand, bit(E_VAR), 0, scope,
+				iter_aliased_channels, chan_words);
+		break;
+	case E_VAR:
+		read_mask_var(ep->extra.e_var, chan_words);
+		break;
+	case E_BINOP:
+		if (strcmp(ep->token.str, "=") == 0)
+			aliased_channels(ep->binop_right, chan_words);
+		break;
+	case D_DECL:
+		aliased_channels(ep->decl_init, chan_words);
+		break;
+	case S_RETURN:
+		aliased_channels(ep->return_expr, chan_words);
+		break;
+	case E_FUNC:
+		if (ep->func_expr->tag != E_BUILTIN && type_is_function(ep->func_expr))
+		{
+			foreach (cep, ep->func_args)
+				aliased_channels(cep, chan_words);
+		}
+		break;
+	default:
+		assert(FALSE);
+	}
+	return TRUE;
+}
+
+/* Add the channels of array and string variables that expression ep
+   may evaluate to (a pointer to) */
+static void aliased_channels(Node *ep, seqMask *chan_words)
+{
+	Node	*cep;
+	Type	*t;
+
+	if (!ep)
+		return;
+	switch (ep->tag)
+	{
+	case E_PAREN:
+		aliased_channels(ep->paren_expr, chan_words);
+		break;
+	case E_CAST:
+		aliased_channels(ep->cast_operand, chan_words);
+		break;
+	case E_TERNOP:
+		aliased_channels(ep->ternop_then, chan_words);
+		aliased_channels(ep->ternop_else, chan_words);
+		break;
+	case E_BINOP:
+		if (strcmp(ep->token.str, "+") == 0 || strcmp(ep->token.str, "-") == 0)
+			aliased_channels(ep->binop_left, chan_words);
+		if (strcmp(ep->token.str, "+") == 0 || strcmp(ep->token.str, "-") == 0
+			|| strcmp(ep->token.str, "=") == 0 || strcmp(ep->token.str, ",") == 0)
+			aliased_channels(ep->binop_right, chan_words);
+		break;
+	case E_INIT:
+		foreach (cep, ep->init_elems)
+			aliased_channels(cep, chan_words);
+		break;
+	case E_VAR:
+		t = ep->extra.e_var->type;
+		if (t->tag == T_ARRAY || (t->tag == T_PRIM && t->val.prim == P_STRING))
+			read_mask_var(ep->extra.e_var, chan_words);
+		break;
+	default:
+		break;
+	}
+}
@@ -155,6 +155,9 @@ static void parse_option(char *s)
 	case 'a':
 		options.async = opt_val;
 		break;
+	case 'b':
+		options.batch = opt_val;
+		break;
 	case 'c':
 		options.conn = opt_val;
 		break;
@@ -164,6 +167,12 @@ static void parse_option(char *s)
 	case 'e':
 		options.newef = opt_val;
 		break;
+	case 'L':
+		options.lockfree = opt_val;
+		break;
+	case 'T':
+		options.coop = opt_val;
+		break;
 	case 'r':
 		options.reent = opt_val;
 		break;
@@ -195,6 +204,7 @@ static void print_usage(void)
 	report("options:\n");
 	report("  -o <outfile> - override name of output file\n");
 	report("  +a           - do asynchronous pvGet\n");
+	report("  +b           - batch monitor events (safe mode only)\n");
 	report("  -c           - don't wait for all connects\n");
 	report("  +d           - turn on debug run-time option\n");
 	report("  -e           - don't use new event flag mode\n");
@@ -203,6 +213,8 @@ static void print_usage(void)
 	report("  -i           - don't register commands/programs\n");
 	report("  +r           - make reentrant at run-time\n");
 	report("  +s           - safe mode (implies +r, overrides -r)\n");
+	report("  +L           - lock-free access to shared channel buffers\n");
+	report("  +T           - run all state sets in one thread\n");
 	report("  -w           - suppress compiler warnings\n");
 	report("  +W           - enable extra compiler warnings\n");
 	report("example:\n snc +a -c vacuum.st\n");
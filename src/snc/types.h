@@ -65,6 +65,9 @@ struct options
 	uint	reent:1;		/* reentrant */
 	uint	safe:1;			/* safe (no globals) */
 	uint	newef:1;		/* new event flag mode */
+	uint	lockfree:1;		/* lock-free shared buffers */
+	uint	batch:1;		/* batch monitor events */
+	uint	coop:1;			/* run all state sets in one thread */
 
 					/* compile time options */
 	uint	main:1;			/* generate main program */
@@ -73,7 +76,7 @@ struct options
 	uint	xwarn:1;		/* extra compiler warnings */
 };
 
-#define DEFAULT_OPTIONS {0,1,0,0,0,1,0,1,1,0}
+#define DEFAULT_OPTIONS {0,1,0,0,0,1,0,0,0,0,1,1,0}
 
 struct state_options			/* run-time state options */
 {
@@ -95,12 +98,15 @@ struct token				/* for the lexer and parser */
 struct when				/* extra data for when clauses */
 {
 	Node		*next_state;	/* declaration of target state */
+	uint		incremental:1;	/* evaluate condition only after one
+					   of its events */
 };
 
 struct state				/* extra data for state clauses */
 {
 	uint		index;		/* index in array of seqState structs */
 	uint		is_target;	/* is this state a target state? */
+	uint		has_read_mask;	/* whether a read mask was generated */
 	StateOptions	options;	/* state options */
 	VarList		*var_list;	/* list of 'local' variables */
 };
@@ -109,6 +115,10 @@ struct state_set			/* extra data for state set clauses */
 {
 	uint		num_states;	/* number of states */
 	VarList		*var_list;	/* list of 'local' variables */
+	uint		var_subset;	/* local copy (safe mode) holds only
+					   the used_vars */
+	Var		**used_vars;	/* program variables used in here */
+	uint		num_used_vars;	/* number of used_vars */
 };
 
 /* Expression types */
@@ -125,7 +135,7 @@ enum node_tag			/* description [child nodes...] */
 	D_STATE,		/* state statement [defns,entry,whens,exit] */
 	D_STRUCTDEF,		/* struct definition [members] */
 	D_SYNC,			/* sync statement [subscr,evflag] */
-	D_SYNCQ,		/* syncq statement [subscr,evflag,maxqsize] */
+	D_SYNCQ,		/* syncq statement [subscr,evflag,maxqsize,options] */
 	D_WHEN,			/* when statement [cond,block] */
 
 	E_BINOP,		/* binary operator [left,right] */
@@ -238,6 +248,10 @@ struct sync_queue
 	SyncQ	*next;
 	uint	index;
 	uint	size;
+	const char *policy;		/* C name of overflow policy */
+	uint	bytes:1;		/* whether size is in bytes */
+	uint	watermark;		/* wakeup watermark (or 0) */
+	char	*timeout;		/* wakeup timeout (or NULL) */
 };
 
 struct chan_list
@@ -368,6 +382,7 @@ enum multiplicity
 #define syncq_subscr	children[0]
 #define syncq_evflag	children[1]
 #define syncq_size	children[2]
+#define syncq_options	children[3]
 #define ternop_cond	children[0]
 #define ternop_then	children[1]
 #define ternop_else	children[2]
@@ -400,7 +415,7 @@ node_info[]
 	{ "D_STATE",	4 },
 	{ "D_STRUCTDEF",1 },
 	{ "D_SYNC",	2 },
-	{ "D_SYNCQ",	3 },
+	{ "D_SYNCQ",	4 },
 	{ "D_WHEN",	2 },
 	{ "E_BINOP",	2 },
 	{ "E_BUILTIN",	0 },
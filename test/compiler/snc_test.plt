@@ -20,14 +20,18 @@ my $tests = {
   misplacedExit           => { warnings => 0, errors => 1  },
   namingConflict          => { warnings => 0, errors => 0  },
   nesting_depth           => { warnings => 0, errors => 0  },
-  pvArray                 => { warnings => 0, errors => 21 },
+  pvArray                 => { warnings => 0, errors => 22 },
   pvNotAssigned           => { warnings => 0, errors => 20 },
   reservedId              => { warnings => 0, errors => 2  },
   state_not_reachable     => { warnings => 3, errors => 0  },
   sync_not_assigned       => { warnings => 0, errors => 1  },
+  sync_request_coop       => { warnings => 0, errors => 2  },
   syncq_no_size           => { warnings => 1, errors => 0  },
   syncq_not_assigned      => { warnings => 0, errors => 1  },
+  syncq_policy_twice      => { warnings => 0, errors => 1  },
+  syncq_policy_unknown    => { warnings => 0, errors => 1  },
   syncq_size_out_of_range => { warnings => 0, errors => 1  },
+  syncq_watermark         => { warnings => 1, errors => 2  },
   type_not_allowed        => { warnings => 2, errors => 9  },
 };
 
@@ -0,0 +1,106 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in file LICENSE that is included with this distribution.
+\*************************************************************************/
+#include <string.h>
+
+#include "pv.h"
+#include "epicsThread.h"
+#include "epicsEvent.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+static volatile int numConnected, numGets, numPuts, numMonitors;
+static void *lastArg;
+static unsigned lastCount;
+static char getValue[1000], monValue[1000];
+
+static void connHandler(int conn, void *arg)
+{
+    numConnected += conn;
+}
+
+static void eventHandler(pvEventType evt, void *arg, pvType type, unsigned count, pvValue *value, pvStat status)
+{
+    lastArg = arg;
+    lastCount = count;
+    switch (evt) {
+    case pvEventGet:
+        memcpy(getValue, value, pv_size_n(type, count));
+        numGets++;
+        break;
+    case pvEventPut:
+        numPuts++;
+        break;
+    case pvEventMonitor:
+        memcpy(monValue, value, pv_size_n(type, count));
+        numMonitors++;
+        break;
+    }
+}
+
+/* Wait until *counter reaches n, or time out after 5 seconds */
+static int waitFor(volatile int *counter, int n)
+{
+    int i;
+
+    for (i = 0; i < 500 && *counter < n; i++)
+        epicsThreadSleep(0.01);
+    return *counter >= n;
+}
+
+MAIN(pvLoopTest)
+{
+    pvSystem sys;
+    pvVar v1, v2, v3, g;
+    pvLong put[3] = {1, 2, 3};
+    pvDouble *dv = (pvDouble *)monValue;
+
+    testPlan(31);
+
+    testOk1(pvSysCreateByName(&sys, "nonsense") == pvStatERROR);
+    testOk1(pvSysCreateByName(&sys, "loop") == pvStatOK);
+    testOk1(strcmp(pvSysGetName(sys), "loop") == 0);
+
+    testOk1(pvVarCreate(sys, "x?count=3", connHandler, eventHandler, &v1, &v1) == pvStatOK);
+    testOk1(pvVarCreate(sys, "x?count=3", connHandler, eventHandler, &v2, &v2) == pvStatOK);
+    testOk1(waitFor(&numConnected, 2));
+    testOk1(pvVarGetCount(&v1) == 3);
+    testOk1(pvVarCreate(sys, "y?foo=1", connHandler, eventHandler, &v3, &v3) == pvStatERROR);
+    testOk1(pvVarCreate(sys, "y?count=0", connHandler, eventHandler, &v3, &v3) == pvStatERROR);
+
+    /* a new subscription gets the current value */
+    testOk1(pvVarMonitorOn(&v1, pvTypeDOUBLE, 3, &v1) == pvStatOK);
+    testOk1(waitFor(&numMonitors, 1) && lastArg == &v1);
+    testOk1(lastCount == 3 && dv[0] == 0 && dv[2] == 0);
+
+    /* a put through the other channel completes, and is posted */
+    testOk1(pvVarPutCallback(&v2, pvTypeLONG, 3, put, &v2) == pvStatOK);
+    testOk1(waitFor(&numPuts, 1));
+    testOk1(waitFor(&numMonitors, 2));
+    testOk1(dv[0] == 1 && dv[1] == 2 && dv[2] == 3);
+
+    /* count 0 means the native count */
+    testOk1(pvVarGetCallback(&v2, pvTypeTIME_STRING, 0, &v2) == pvStatOK);
+    testOk1(waitFor(&numGets, 1) && lastCount == 3);
+    testOk1(strcmp(((pvString *)pv_value_ptr(getValue, pvTypeTIME_STRING))[2], "3") == 0);
+
+    /* after unsubscribing, puts are not posted */
+    testOk1(pvVarMonitorOff(&v1) == pvStatOK);
+    testOk1(pvVarPutNoBlock(&v2, pvTypeSTRING, 1, "7") == pvStatOK);
+    testOk1(pvVarGetCallback(&v1, pvTypeSHORT, 1, &v1) == pvStatOK);
+    testOk1(waitFor(&numGets, 2) && *(pvShort *)getValue == 7);
+    testOk1(numMonitors == 2);
+
+    testOk1(pvVarDestroy(&v1) == pvStatOK);
+    testOk1(pvVarDestroy(&v2) == pvStatOK);
+
+    /* generated events */
+    testOk1(pvVarCreate(sys, "g?rate=100&count=2", connHandler, eventHandler, &g, &g) == pvStatOK);
+    testOk1(pvVarMonitorOn(&g, pvTypeDOUBLE, 2, &g) == pvStatOK);
+    testOk(waitFor(&numMonitors, 12), "generated monitors");
+    testOk(dv[0] >= 8 && dv[1] == dv[0], "value %g %g", dv[0], dv[1]);
+    testOk1(pvVarDestroy(&g) == pvStatOK);
+
+    return testDone();
+}
@@ -38,6 +38,9 @@ static epicsEventId wdone, rdone, ready;
 static const int threadTestIterations = 1000000;
 static const size_t threadTestMaxNumElems = 20;
 
+static const ELEM lapTestIterations = 100000;
+static const size_t lapTestMaxNumElems = 9;
+
 static int readerLost, writerLost;
 
 static void readerTask(void *arg)
@@ -80,20 +83,111 @@ static void writerTask(void *arg)
     epicsEventSignal(wdone);
 }
 
+/* byte queue records take 8 bytes in addition to their data */
+#define recSize(len) (8 + ((len) + 7) / 8 * 8)
+
+struct record {
+    char data[40];
+    size_t len;
+};
+
+/* seqQueueFunc that also remembers the size of a record */
+static void *getRecord(void *dest, const void *src, size_t size)
+{
+    struct record *r = (struct record *)dest;
+
+    r->len = size;
+    return memcpy(r->data, src, size);
+}
+
+/* seqQueueFunc that appends elements to an array */
+static void *getAppend(void *dest, const void *src, size_t elemSize)
+{
+    ELEM **next = (ELEM **)dest;
+
+    memcpy(*next, src, elemSize);
+    return (*next)++;
+}
+
+#define mpscNumWriters 2
+#define mpscNumPolicies 3
+static const size_t mpscMaxNumElems = 4;
+
+static volatile int mpscWritersDone;
+static int mpscLost[mpscNumWriters], mpscReceived, mpscOrdered;
+static epicsEventId mpscDone[mpscNumWriters];
+
+struct mpscWriterArg {
+    QUEUE q;
+    int id;
+};
+
+static void mpscWriterTask(void *arg)
+{
+    struct mpscWriterArg *w = (struct mpscWriterArg *)arg;
+    ELEM data;
+    int i, lost = 0;
+
+    for (i = 0; i < threadTestIterations; i++) {
+        data = ((ELEM)w->id << 32) | (ELEM)i;
+        if (seqQueuePut(w->q, &data)) lost++;
+    }
+    mpscLost[w->id] = lost;
+    epicsEventSignal(mpscDone[w->id]);
+}
+
+static void mpscReaderTask(void *arg)
+{
+    QUEUE q = (QUEUE)arg;
+    ELEM data[3], *next;
+    long last[mpscNumWriters];
+    int id;
+    size_t i, n;
+
+    for (id = 0; id < mpscNumWriters; id++)
+        last[id] = -1;
+    mpscReceived = 0;
+    mpscOrdered = TRUE;
+    while (TRUE) {
+        int done = mpscWritersDone;
+        /* vary the number of elements removed at once */
+        next = data;
+        n = seqQueueGetMany(q, getAppend, &next, mpscReceived % 3 + 1);
+        if (n == 0) {
+            if (done) break;
+            continue;
+        }
+        mpscReceived += (int)n;
+        for (i = 0; i < n; i++) {
+            id = (int)(data[i] >> 32);
+            if (id < 0 || id >= mpscNumWriters || (long)(data[i] & 0xffffffffu) <= last[id]) {
+                mpscOrdered = FALSE;
+            } else {
+                last[id] = (long)(data[i] & 0xffffffffu);
+            }
+        }
+    }
+    epicsEventSignal(rdone);
+}
+
 MAIN(queueTest)
 {
     size_t numElems;
     QUEUE q;
     epicsThreadId reader, writer;
+    int policy, bytes;
 
     errlogSetSevToLog(errlogFatal+1);
 
-    testPlan(212 + 2*threadTestMaxNumElems);
+    testPlan(487 + 2*lapTestMaxNumElems + 2*threadTestMaxNumElems
+        + 2*3*mpscNumPolicies*mpscMaxNumElems);
 
     testOk1(seqQueueCreate(1,0)==0);
     testOk1(seqQueueCreate(0,1)==0);
+    testOk1(seqQueueCreateBytes(16,0,seqQueueOverwriteLast)==0);
+    testOk1(seqQueueCreateBytes(8,8,seqQueueOverwriteLast)==0);
 
-#define maxNumElems 3
+#define maxNumElems 4
 
     for (numElems = 1; numElems <= maxNumElems; numElems++) {
         ELEM put[2*maxNumElems];
@@ -135,6 +229,163 @@ MAIN(queueTest)
                 }
             }
         }
+        testOk1(seqQueueInvariant(q));
+        seqQueueDestroy(q);
+    }
+
+    for (numElems = 1; numElems <= maxNumElems; numElems++) {
+        ELEM put[maxNumElems], get[maxNumElems], *next;
+        size_t i, maxNum, n;
+
+        testDiag("sequential queueTest of seqQueueGetMany with numElems=%u", (unsigned)numElems);
+
+        q = seqQueueCreate(numElems, sizeof(ELEM));
+        if (!q) {
+            testAbort("seqQueueCreate failed");
+        }
+        for (i = 0 ; i < numElems ; i++)
+            put[i] = i;
+        for (maxNum = 0; maxNum <= numElems + 1; maxNum++) {
+            int same = TRUE;
+            size_t expected = maxNum < numElems ? maxNum : numElems;
+
+            for (i = 0; i < numElems; i++)
+                seqQueuePut(q, put+i);
+            next = get;
+            n = seqQueueGetMany(q, getAppend, &next, maxNum);
+            testOk(n == expected, "got %lu of %lu", (unsigned long)n, (unsigned long)maxNum);
+            for (i = 0; i < n; i++)
+                same = same && get[i] == put[i];
+            testOk(same && next == get + n, "got elements in order");
+            testOk(seqQueueUsed(q) == numElems - n, "Used: %lu == %lu",
+                (unsigned long)seqQueueUsed(q), (unsigned long)(numElems - n));
+            seqQueueFlush(q);
+        }
+        seqQueueDestroy(q);
+    }
+
+    for (policy = 0; policy < mpscNumPolicies; policy++) {
+        /* put 5 elements into a queue of 3 */
+        static const ELEM expected[mpscNumPolicies][3] = {{0,1,4}, {2,3,4}, {0,1,2}};
+        static const unsigned expectedNumPut[mpscNumPolicies] = {5, 5, 3};
+        ELEM i, got[3];
+        int full = 0;
+
+        testDiag("sequential queueTest with policy=%d", policy);
+
+        q = seqQueueCreatePolicy(3, sizeof(ELEM), (enum seqQueuePolicy)policy);
+        if (!q) {
+            testAbort("seqQueueCreatePolicy failed");
+        }
+        for (i = 0; i < 5; i++)
+            full += seqQueuePut(q, &i);
+        testOk(full == 2, "put returned full %d times", full);
+        for (i = 0; i < 3; i++)
+            seqQueueGet(q, got+i);
+        testOk(memcmp(got, expected[policy], sizeof(got)) == 0,
+            "got %d,%d,%d", (int)got[0], (int)got[1], (int)got[2]);
+        testOk(seqQueueNumPut(q) == expectedNumPut[policy], "put: %.0f==%u",
+            (double)seqQueueNumPut(q), expectedNumPut[policy]);
+        testOk(seqQueueNumDropped(q) == 2, "dropped: %.0f==2", (double)seqQueueNumDropped(q));
+        testOk(seqQueueHighWater(q) == 3, "highWater: %u==3", (unsigned)seqQueueHighWater(q));
+        testOk1(seqQueueInvariant(q));
+        seqQueueDestroy(q);
+    }
+
+    for (policy = 0; policy < mpscNumPolicies; policy++) {
+        static const ELEM expected[mpscNumPolicies][3] = {{0,1,4}, {2,3,4}, {0,1,2}};
+        static const unsigned expectedNumPut[mpscNumPolicies] = {5, 5, 3};
+        ELEM i, got[3];
+        int full = 0;
+
+        testDiag("sequential byte queueTest with policy=%d", policy);
+
+        /* room for 3 elements */
+        q = seqQueueCreateBytes(3*recSize(sizeof(ELEM)), sizeof(ELEM),
+            (enum seqQueuePolicy)policy);
+        if (!q) {
+            testAbort("seqQueueCreateBytes failed");
+        }
+        for (i = 0; i < 5; i++)
+            full += seqQueuePut(q, &i);
+        testOk(full == 2, "put returned full %d times", full);
+        for (i = 0; i < 3; i++)
+            seqQueueGet(q, got+i);
+        testOk(memcmp(got, expected[policy], sizeof(got)) == 0,
+            "got %d,%d,%d", (int)got[0], (int)got[1], (int)got[2]);
+        testOk(seqQueueNumPut(q) == expectedNumPut[policy], "put: %.0f==%u",
+            (double)seqQueueNumPut(q), expectedNumPut[policy]);
+        testOk(seqQueueNumDropped(q) == 2, "dropped: %.0f==2", (double)seqQueueNumDropped(q));
+        testOk(seqQueueHighWater(q) == 3*recSize(sizeof(ELEM)), "highWater: %u==%u",
+            (unsigned)seqQueueHighWater(q), (unsigned)(3*recSize(sizeof(ELEM))));
+        testOk1(seqQueueInvariant(q));
+        seqQueueDestroy(q);
+    }
+
+    {
+        struct record put, get;
+        ELEM i, k, next = 0;
+        int ordered = TRUE;
+
+        testDiag("sequential lap queueTest with varying element sizes");
+
+        q = seqQueueCreateBytes(200, sizeof(put.data), seqQueueDropNewest);
+        if (!q) {
+            testAbort("seqQueueCreateBytes failed");
+        }
+        /* element i has i%41 bytes with value i&0xff */
+        for (i = 0; i <= lapTestIterations; i++) {
+            if (seqQueueIsFull(q) || i == lapTestIterations) {
+                for (k = 0; seqQueueIsFull(q) || k <= i % 3 || i == lapTestIterations; k++) {
+                    size_t j;
+
+                    if (seqQueueGetF(q, getRecord, &get))
+                        break;
+                    ordered = ordered && get.len == next % 41;
+                    for (j = 0; j < get.len; j++)
+                        ordered = ordered && get.data[j] == (char)(next & 0xff);
+                    next++;
+                }
+            }
+            put.len = (size_t)(i % 41);
+            memset(put.data, (int)(i & 0xff), put.len);
+            if (i < lapTestIterations)
+                seqQueuePutSizeF(q, memcpy, put.data, put.len);
+        }
+        testOk(ordered && next == lapTestIterations, "elements arrive in order");
+        testOk(seqQueueNumDropped(q) == 0, "dropped: %.0f==0", (double)seqQueueNumDropped(q));
+        testOk1(seqQueueInvariant(q));
+        seqQueueDestroy(q);
+    }
+
+    for (numElems = 1; numElems <= lapTestMaxNumElems; numElems++) {
+        ELEM i, j, k, next = 0;
+        int ordered = TRUE;
+
+        testDiag("sequential lap queueTest with numElems=%u", (unsigned)numElems);
+
+        q = seqQueueCreate(numElems, sizeof(ELEM));
+        if (!q) {
+            testAbort("seqQueueCreate failed");
+        }
+        /* cycle through the queue many times, removing a varying number
+           of elements whenever it is full, so it never overflows */
+        for (i = 0; i < lapTestIterations; i++) {
+            seqQueuePut(q, &i);
+            if (!seqQueueIsFull(q))
+                continue;
+            for (k = 0; k <= i % numElems; k++) {
+                seqQueueGet(q, &j);
+                ordered = ordered && j == next;
+                next = j + 1;
+            }
+        }
+        while (!seqQueueGet(q, &j)) {
+            ordered = ordered && j == next;
+            next = j + 1;
+        }
+        testOk(ordered && next == lapTestIterations, "elements arrive in order");
+        testOk1(seqQueueInvariant(q));
         seqQueueDestroy(q);
     }
 
@@ -164,6 +415,54 @@ MAIN(queueTest)
         testPass("ok");
     }
 
+    for (bytes = 0; bytes <= 1; bytes++)
+    for (policy = 0; policy < mpscNumPolicies; policy++)
+    for (numElems = 1; numElems <= mpscMaxNumElems; numElems++) {
+        struct mpscWriterArg warg[mpscNumWriters];
+        int id, lost = 0, dropped;
+
+        testDiag("concurrent %squeueTest with %d writers, policy=%d, and numElems=%u",
+            bytes ? "byte " : "", mpscNumWriters, policy, (unsigned)numElems);
+
+        if (bytes)
+            q = seqQueueCreateBytes(numElems*recSize(sizeof(ELEM)), sizeof(ELEM),
+                (enum seqQueuePolicy)policy);
+        else
+            q = seqQueueCreatePolicy(numElems, sizeof(ELEM), (enum seqQueuePolicy)policy);
+        mpscWritersDone = FALSE;
+        for (id = 0; id < mpscNumWriters; id++) {
+            mpscDone[id] = epicsEventCreate(epicsEventEmpty);
+            warg[id].q = q;
+            warg[id].id = id;
+        }
+        reader = epicsThreadCreate("reader", epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackSmall), mpscReaderTask, q);
+        for (id = 0; id < mpscNumWriters; id++) {
+            writer = epicsThreadCreate("writer", epicsThreadPriorityMedium,
+                epicsThreadGetStackSize(epicsThreadStackSmall), mpscWriterTask, warg+id);
+            if (!reader || !writer) {
+                testAbort("epicsThreadCreate failed");
+            }
+        }
+        for (id = 0; id < mpscNumWriters; id++) {
+            epicsEventWait(mpscDone[id]);
+            lost += mpscLost[id];
+        }
+        mpscWritersDone = TRUE;
+        epicsEventWait(rdone);
+        testOk(mpscOrdered, "elements from each writer arrive in order");
+        dropped = (int)seqQueueNumDropped(q);
+        testOk(mpscReceived + dropped == mpscNumWriters*threadTestIterations,
+            "%d+%d==%d", mpscReceived, dropped, mpscNumWriters*threadTestIterations);
+        /* with drop_oldest, a put may have to make room more than once */
+        testOk(policy == seqQueueDropOldest ? lost <= dropped : lost == dropped,
+            "lost: %d, dropped: %d", lost, dropped);
+
+        for (id = 0; id < mpscNumWriters; id++)
+            epicsEventDestroy(mpscDone[id]);
+        seqQueueDestroy(q);
+    }
+
     epicsEventDestroy(wdone);
     epicsEventDestroy(rdone);
     epicsEventDestroy(ready);
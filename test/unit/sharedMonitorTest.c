@@ -0,0 +1,93 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/* Two instances of a program monitor the same PVs, so the second one
+ * joins the first one's subscriptions. Check that each instance counts
+ * its channels' first monitor exactly once, as option +c relies on, and
+ * that the second one gets the current value of a PV that no longer
+ * changes. */
+#include <stddef.h>
+
+#include "seq.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+struct vars { double x; double y; };
+
+static PROG *progs[2];
+static epicsEventId started;
+
+static void init(PROG_ID progId)
+{
+}
+
+static void entry(SS_ID ssId)
+{
+    struct vars *pVar = (struct vars *)ssId->var;
+
+    if (ssId->prog->instance == 0) {
+        pVar->y = 42;
+        seq_pvPut(ssId, 1, SYNC);
+    }
+    progs[ssId->prog->instance] = ssId->prog;
+    epicsEventSignal(started);
+}
+
+static seqBool event_idle(SS_ID ssId, int *transNum, int *nextState)
+{
+    return FALSE;
+}
+
+static void action_idle(SS_ID ssId, int transNum, int *nextState)
+{
+}
+
+static seqChan chans[] = {
+    {"sharedMonitorTest?rate=200", offsetof(struct vars, x), "x", P_DOUBLE,
+        1, 1, 0, TRUE, 0, 0},
+    {"sharedMonitorTest:y", offsetof(struct vars, y), "y", P_DOUBLE,
+        1, 2, 0, TRUE, 0, 0},
+};
+static const seqMask mask_idle[] = { 0 };
+static seqState states[] = {
+    {"idle", action_idle, event_idle, 0, 0, mask_idle, 0, 0, 0},
+};
+static seqSS statesets[] = {
+    {"idle", states, 1, 0, 0, 0},
+};
+static seqProgram sharedMonitorTest = {
+    MAGIC, "sharedMonitorTest", chans, 2, statesets, 1, sizeof(struct vars),
+    "", 1, OPT_REENT | OPT_CONN | OPT_NEWEF, init, entry, 0, 0
+};
+
+MAIN(sharedMonitorTest)
+{
+    int i;
+
+    testPlan(8);
+    started = epicsEventMustCreate(epicsEventEmpty);
+
+    /* the second instance joins while events for x keep coming, and
+       after the last one for y */
+    for (i = 0; i < 2; i++) {
+        seq(&sharedMonitorTest, "pvsys=loop", 0);
+        testOk(epicsEventWaitWithTimeout(started, 5.0) == epicsEventWaitOK
+            && progs[i], "instance %d got its first monitor", i);
+    }
+    if (!progs[0] || !progs[1])
+        testAbort("instances did not start");
+    epicsThreadSleep(0.2);
+
+    for (i = 0; i < 2; i++) {
+        testOk(progs[i]->monitorCount == 2, "instance %d: monitored=%u",
+            i, progs[i]->monitorCount);
+        testOk(progs[i]->gotMonitorCount == 2, "instance %d: got monitor=%u",
+            i, progs[i]->gotMonitorCount);
+    }
+    testOk(progs[1]->chan[1].dbch->dbCount == 1, "instance 1: dbCount=%u",
+        progs[1]->chan[1].dbch->dbCount);
+    testOk(((struct vars *)progs[1]->var)->y == 42, "instance 1: y=%g",
+        ((struct vars *)progs[1]->var)->y);
+    return testDone();
+}